@@ -0,0 +1,281 @@
+/*
+ * Microbenchmark of the core outside the backend.  Builds the same shapes
+ * of documents as setup.sql directly in binary CBOR and reports the time
+ * per value and the throughput of decoding, encoding, comparing and
+ * hashing them, relative to the size of the binary encoding.
+ *
+ * usage: cbor_bench [docs [loops]]
+ */
+#include "cbor_core.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct BenchBuf
+{
+	uint8	   *data;
+	Size		len;
+	Size		maxlen;
+}	BenchBuf;
+
+typedef struct BenchDoc
+{
+	BenchBuf	bin;
+	Cbor	   *doc;
+	Cbor	   *doc2;
+}	BenchDoc;
+
+static volatile uint64 bench_sink;
+
+static void
+bench_put(BenchBuf * buf, const void *data, Size len)
+{
+	if (buf->len + len > buf->maxlen)
+	{
+		buf->maxlen = (buf->len + len) * 2;
+		buf->data = realloc(buf->data, buf->maxlen);
+		if (!buf->data)
+			abort();
+	}
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void
+bench_put_head(BenchBuf * buf, uint8 major, uint64 value)
+{
+	uint8		head[9];
+	int			bytes;
+	int			i;
+
+	if (value < 24)
+	{
+		head[0] = major << 5 | (uint8) value;
+		bench_put(buf, head, 1);
+		return;
+	}
+
+	bytes = value <= 0xff ? 1 : value <= 0xffff ? 2 : value <= 0xffffffff ? 4 : 8;
+	head[0] = major << 5 | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27);
+	for (i = 0; i < bytes; ++i)
+		head[1 + i] = (uint8) (value >> (8 * (bytes - 1 - i)));
+	bench_put(buf, head, 1 + bytes);
+}
+
+static void
+bench_put_text(BenchBuf * buf, const char *str, Size len)
+{
+	bench_put_head(buf, 3, len);
+	bench_put(buf, str, len);
+}
+
+static void
+bench_put_int(BenchBuf * buf, int64 value)
+{
+	if (value < 0)
+		bench_put_head(buf, 1, (uint64) (-1 - value));
+	else
+		bench_put_head(buf, 0, (uint64) value);
+}
+
+static void
+bench_put_double(BenchBuf * buf, double value)
+{
+	uint64		bits;
+	uint8		head[9];
+	int			i;
+
+	memcpy(&bits, &value, sizeof(bits));
+	head[0] = 0xfb;
+	for (i = 0; i < 8; ++i)
+		head[1 + i] = (uint8) (bits >> (56 - 8 * i));
+	bench_put(buf, head, sizeof(head));
+}
+
+/* {"k": [{"k": [... seed ...]}]} */
+static void
+bench_deep(BenchBuf * buf, int seed)
+{
+	int			i;
+
+	for (i = 0; i < 64; ++i)
+	{
+		bench_put_head(buf, 5, 1);
+		bench_put_text(buf, "k", 1);
+		bench_put_head(buf, 4, 1);
+	}
+	bench_put_int(buf, seed);
+}
+
+/* {"key1": seed + 1, ...} */
+static void
+bench_wide(BenchBuf * buf, int seed)
+{
+	char		key[16];
+	int			i;
+
+	bench_put_head(buf, 5, 256);
+	for (i = 1; i <= 256; ++i)
+	{
+		bench_put_text(buf, key, snprintf(key, sizeof(key), "key%d", i));
+		bench_put_int(buf, seed + i);
+	}
+}
+
+/* 32 strings of 128 hex digits */
+static void
+bench_strings(BenchBuf * buf, int seed)
+{
+	static const char digits[] = "0123456789abcdef";
+	char		str[128];
+	uint64		state = (uint64) seed * 32 + 1;
+	int			i;
+	int			j;
+
+	bench_put_head(buf, 4, 32);
+	for (i = 0; i < 32; ++i)
+	{
+		for (j = 0; j < (int) sizeof(str); ++j)
+		{
+			state = state * UINT64CONST(6364136223846793005) + UINT64CONST(1442695040888963407);
+			str[j] = digits[state >> 60];
+		}
+		bench_put_text(buf, str, sizeof(str));
+	}
+}
+
+/* small, negative and large integers and doubles */
+static void
+bench_numbers(BenchBuf * buf, int seed)
+{
+	int			i;
+
+	bench_put_head(buf, 4, 256);
+	for (i = 1; i <= 256; ++i)
+	{
+		switch (i % 4)
+		{
+			case 0:
+				bench_put_int(buf, seed + i);
+				break;
+			case 1:
+				bench_put_int(buf, -(int64) (seed + i) * 1000003);
+				break;
+			case 2:
+				bench_put_int(buf, (int64) (seed + i) * INT64_C(4294967311));
+				break;
+			default:
+				bench_put_double(buf, (seed + i) / 7.0);
+				break;
+		}
+	}
+}
+
+static double
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void
+bench_report(const char *operation, const char *shape, int docs, int loops, Size bytes, double ns)
+{
+	int			ops = docs * loops;
+
+	printf("%-8s %-8s %8d %12.1f %10.1f\n", operation, shape, docs,
+		   ns / ops, (double) bytes * loops / (ns / 1e9) / (1024 * 1024));
+}
+
+static void
+bench_shape(const char *shape, void (*generate) (BenchBuf * buf, int seed), int docs, int loops)
+{
+	BenchDoc   *items = calloc(docs, sizeof(BenchDoc));
+	Size		bytes = 0;
+	char	   *out;
+	double		start;
+	int			loop;
+	int			i;
+
+	if (!items)
+		abort();
+
+	for (i = 0; i < docs; ++i)
+	{
+		generate(&items[i].bin, i + 1);
+		items[i].doc = cbor_core_decode(items[i].bin.data, items[i].bin.len, NULL);
+		items[i].doc2 = cbor_core_decode(items[i].bin.data, items[i].bin.len, NULL);
+		bytes += items[i].bin.len;
+	}
+	out = malloc(bytes);
+	if (!out)
+		abort();
+
+	start = bench_now();
+	for (loop = 0; loop < loops; ++loop)
+	{
+		for (i = 0; i < docs; ++i)
+			free(cbor_core_decode(items[i].bin.data, items[i].bin.len, NULL));
+	}
+	bench_report("decode", shape, docs, loops, bytes, bench_now() - start);
+
+	start = bench_now();
+	for (loop = 0; loop < loops; ++loop)
+	{
+		char	   *end = out;
+
+		for (i = 0; i < docs; ++i)
+			end = cbor_core_encode(end, &items[i].doc->root, 0, 1);
+		bench_sink += end - out;
+	}
+	bench_report("encode", shape, docs, loops, bytes, bench_now() - start);
+
+	start = bench_now();
+	for (loop = 0; loop < loops; ++loop)
+	{
+		for (i = 0; i < docs; ++i)
+			bench_sink += cbor_cmp_entry(&items[i].doc->root, 0, 1, &items[i].doc2->root, 0, 1);
+	}
+	bench_report("cmp", shape, docs, loops, bytes, bench_now() - start);
+
+	start = bench_now();
+	for (loop = 0; loop < loops; ++loop)
+	{
+		for (i = 0; i < docs; ++i)
+			bench_sink += cbor_hash_entry(&items[i].doc->root, 0, 1);
+	}
+	bench_report("hash", shape, docs, loops, bytes, bench_now() - start);
+
+	for (i = 0; i < docs; ++i)
+	{
+		free(items[i].bin.data);
+		free(items[i].doc);
+		free(items[i].doc2);
+	}
+	free(items);
+	free(out);
+}
+
+int
+main(int argc, char **argv)
+{
+	int			docs = argc > 1 ? atoi(argv[1]) : 1000;
+	int			loops = argc > 2 ? atoi(argv[2]) : 5;
+
+	if (docs < 1 || loops < 1)
+	{
+		fprintf(stderr, "usage: %s [docs [loops]]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%-8s %-8s %8s %12s %10s\n", "op", "shape", "docs", "ns/op", "MB/s");
+	bench_shape("deep", bench_deep, docs, loops);
+	bench_shape("wide", bench_wide, docs, loops);
+	bench_shape("strings", bench_strings, docs, loops);
+	bench_shape("numbers", bench_numbers, docs, loops);
+
+	return 0;
+}
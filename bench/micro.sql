@@ -0,0 +1,23 @@
+--
+-- Time the conversion, comparison and hash functions on every shape of
+-- documents created by setup.sql.  Sizes are in bytes of the text form for
+-- cbor_in and cbor_out and of the encoded form otherwise.
+--
+-- psql variables: loops (evaluations of each function per document)
+--
+
+-- measure single backends only
+SELECT set_config('max_parallel_workers_per_gather', '0', false)
+WHERE current_setting('server_version_num')::int >= 90600;
+
+SELECT * FROM cbor_bench.measure('cbor_in', 'txt::cbor', 'octet_length(txt)', :loops)
+UNION ALL
+SELECT * FROM cbor_bench.measure('cbor_out', 'doc::text', 'octet_length(txt)', :loops)
+UNION ALL
+SELECT * FROM cbor_bench.measure('cbor_decode', 'cbor_decode(bin)', 'octet_length(bin)', :loops)
+UNION ALL
+SELECT * FROM cbor_bench.measure('cbor_encode', 'cbor_encode(doc)', 'octet_length(bin)', :loops)
+UNION ALL
+SELECT * FROM cbor_bench.measure('cbor_cmp', 'cbor_cmp(doc, doc2)', 'octet_length(bin)', :loops)
+UNION ALL
+SELECT * FROM cbor_bench.measure('cbor_hash', 'cbor_hash(doc)', 'octet_length(bin)', :loops);
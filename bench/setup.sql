@@ -0,0 +1,112 @@
+--
+-- Synthetic documents for the benchmarks.  Every shape stresses a different
+-- part of the format: deep nests arrays and maps, wide has maps large enough
+-- to be sorted, strings is dominated by string copies and numbers by the
+-- integer and float encodings.
+--
+-- psql variables: docs (number of documents per shape)
+--
+
+SET client_min_messages TO warning;
+CREATE EXTENSION IF NOT EXISTS cbor;
+DROP SCHEMA IF EXISTS cbor_bench CASCADE;
+CREATE SCHEMA cbor_bench;
+
+CREATE FUNCTION cbor_bench.deep(seed int, depth int DEFAULT 64)
+RETURNS text
+LANGUAGE sql IMMUTABLE
+AS $$
+	SELECT repeat('{"k": [', depth) || seed || repeat(']}', depth);
+$$;
+
+CREATE FUNCTION cbor_bench.wide(seed int, width int DEFAULT 256)
+RETURNS text
+LANGUAGE sql IMMUTABLE
+AS $$
+	SELECT '{' || string_agg(format('"key%s": %s', i, seed + i), ', ') || '}'
+	FROM generate_series(1, width) i;
+$$;
+
+CREATE FUNCTION cbor_bench.strings(seed int, count int DEFAULT 32)
+RETURNS text
+LANGUAGE sql IMMUTABLE
+AS $$
+	SELECT '[' || string_agg('"' || repeat(md5((seed * count + i)::text), 4) || '"', ', ') || ']'
+	FROM generate_series(1, count) i;
+$$;
+
+CREATE FUNCTION cbor_bench.numbers(seed int, count int DEFAULT 256)
+RETURNS text
+LANGUAGE sql IMMUTABLE
+AS $$
+	SELECT '[' || string_agg(CASE i % 4
+								 WHEN 0 THEN (seed + i)::text
+								 WHEN 1 THEN (-(seed + i)::bigint * 1000003)::text
+								 WHEN 2 THEN ((seed + i)::bigint * 4294967311)::text
+								 ELSE ((seed + i) / 7.0::float8)::text
+							 END, ', ') || ']'
+	FROM generate_series(1, count) i;
+$$;
+
+-- keep the values uncompressed, so detoasting them is a plain copy
+CREATE TABLE cbor_bench.docs (
+	id serial PRIMARY KEY,
+	shape text NOT NULL,
+	txt text NOT NULL,
+	doc cbor NOT NULL,
+	doc2 cbor NOT NULL,
+	bin bytea NOT NULL
+);
+ALTER TABLE cbor_bench.docs
+	ALTER COLUMN txt SET STORAGE external,
+	ALTER COLUMN doc SET STORAGE external,
+	ALTER COLUMN doc2 SET STORAGE external,
+	ALTER COLUMN bin SET STORAGE external;
+
+INSERT INTO cbor_bench.docs (shape, txt, doc, doc2, bin)
+SELECT shape, txt::cbor::text, txt::cbor, txt::cbor, cbor_encode(txt::cbor)
+FROM (
+	SELECT s.shape,
+		   CASE s.shape
+			   WHEN 'deep' THEN cbor_bench.deep(i)
+			   WHEN 'wide' THEN cbor_bench.wide(i)
+			   WHEN 'strings' THEN cbor_bench.strings(i)
+			   ELSE cbor_bench.numbers(i)
+		   END AS txt
+	FROM unnest(ARRAY['deep', 'wide', 'strings', 'numbers']) s(shape),
+		 generate_series(1, :docs) i
+) t;
+
+ANALYZE cbor_bench.docs;
+
+--
+-- Evaluate expr over all documents of each shape loops times and report the
+-- time per evaluation and the throughput in bytes of size per second.
+--
+CREATE FUNCTION cbor_bench.measure(label text, expr text, size text, loops int DEFAULT 5)
+RETURNS TABLE (operation text, shape text, docs bigint, "ns/op" numeric, "MB/s" numeric)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+	s text;
+	n bigint;
+	bytes bigint;
+	started timestamptz;
+	elapsed float8;
+BEGIN
+	FOR s IN SELECT DISTINCT d.shape FROM cbor_bench.docs d ORDER BY 1 LOOP
+		EXECUTE format('SELECT count(*), sum(%s) FROM cbor_bench.docs WHERE shape = $1', size)
+			INTO n, bytes USING s;
+
+		started := clock_timestamp();
+		FOR i IN 1..loops LOOP
+			EXECUTE format('SELECT count(%s) FROM cbor_bench.docs WHERE shape = $1', expr) USING s;
+		END LOOP;
+		elapsed := extract(epoch FROM clock_timestamp() - started);
+
+		RETURN QUERY SELECT label, s, n,
+			round((elapsed * 1e9 / (n * loops))::numeric, 1),
+			round((bytes * loops / elapsed / 1e6)::numeric, 1);
+	END LOOP;
+END;
+$$;
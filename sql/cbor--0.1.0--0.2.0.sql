@@ -0,0 +1,508 @@
+SET client_min_messages TO warning;
+SET log_min_messages    TO warning;
+
+-- cbor values may be toasted from this version on, existing columns keep
+-- their storage until ALTER TABLE ... ALTER COLUMN ... SET STORAGE EXTENDED
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::int >= 130000 THEN
+		ALTER TYPE cbor SET (STORAGE = extended);
+	ELSE
+		UPDATE pg_catalog.pg_type SET typstorage = 'x'
+			WHERE oid = 'cbor'::pg_catalog.regtype;
+	END IF;
+END;
+$$;
+
+CREATE FUNCTION cbor_encode_canonical(cbor)
+RETURNS bytea
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_encode_canonical(cbor) IS 'encode with map keys in bytewise order, so equal values give identical bytes';
+
+CREATE FUNCTION cbor_canonicalize(cbor)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_canonicalize(cbor) IS 'reorder the pairs of all maps like cbor_encode_canonical';
+
+CREATE FUNCTION cbor_decode_sequence(bytea)
+RETURNS SETOF cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_decode_sequence(bytea) IS 'decode each item of a cbor sequence';
+
+CREATE FUNCTION cbor_decode_sequence_lo(oid)
+RETURNS SETOF cbor
+AS 'cbor'
+LANGUAGE C VOLATILE STRICT;
+
+COMMENT ON FUNCTION cbor_decode_sequence_lo(oid) IS 'decode each item of a cbor sequence stored in a large object';
+
+
+-- comparison and hash support
+
+CREATE FUNCTION cbor_sortsupport(internal)
+RETURNS void
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_sortsupport(internal) IS 'btree sort support function';
+
+ALTER OPERATOR FAMILY cbor_ops USING btree
+	ADD FUNCTION 2 (cbor, cbor) cbor_sortsupport(internal);
+
+CREATE FUNCTION cbor_hash_extended(cbor, int8)
+RETURNS int8
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_hash_extended(cbor, int8) IS 'cbor 64 bit hash function';
+
+-- extended hash functions are supported from PostgreSQL 11 on
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::int >= 110000 THEN
+		ALTER OPERATOR FAMILY hash_cbor_ops USING hash
+			ADD FUNCTION 2 cbor_hash_extended(cbor, int8);
+	END IF;
+END;
+$$;
+
+
+-- containment operators
+
+CREATE OPERATOR @> (
+	LEFTARG = cbor, RIGHTARG = cbor, PROCEDURE = cbor_contains,
+	COMMUTATOR = '<@',
+	RESTRICT = contsel, JOIN = contjoinsel
+);
+
+CREATE OPERATOR <@ (
+	LEFTARG = cbor, RIGHTARG = cbor, PROCEDURE = cbor_contained,
+	COMMUTATOR = '@>',
+	RESTRICT = contsel, JOIN = contjoinsel
+);
+
+
+-- gin support
+
+CREATE FUNCTION gin_extract_cbor(cbor, internal, internal)
+RETURNS internal
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION gin_extract_cbor_query(cbor, internal, int2, internal, internal, internal, internal)
+RETURNS internal
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION gin_consistent_cbor(internal, int2, cbor, int4, internal, internal, internal, internal)
+RETURNS bool
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION gin_triconsistent_cbor(internal, int2, cbor, int4, internal, internal, internal)
+RETURNS "char"
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE OPERATOR CLASS cbor_ops
+    DEFAULT FOR TYPE cbor USING gin AS
+        OPERATOR	7	@> ,
+        FUNCTION	1	btint4cmp(int4, int4),
+        FUNCTION	2	gin_extract_cbor(cbor, internal, internal),
+        FUNCTION	3	gin_extract_cbor_query(cbor, internal, int2, internal, internal, internal, internal),
+        FUNCTION	4	gin_consistent_cbor(internal, int2, cbor, int4, internal, internal, internal, internal),
+        FUNCTION	6	gin_triconsistent_cbor(internal, int2, cbor, int4, internal, internal, internal),
+        STORAGE		int4;
+
+
+-- access operators
+
+CREATE FUNCTION cbor_object_field(cbor, text)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_object_field(cbor, text) IS 'get cbor map value';
+
+CREATE FUNCTION cbor_object_field_text(cbor, text)
+RETURNS text
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_object_field_text(cbor, text) IS 'get cbor map value as text';
+
+CREATE FUNCTION cbor_array_element(cbor, int4)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_array_element(cbor, int4) IS 'get cbor array element or map value of integer key';
+
+CREATE FUNCTION cbor_array_element_text(cbor, int4)
+RETURNS text
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_array_element_text(cbor, int4) IS 'get cbor array element or map value of integer key as text';
+
+CREATE FUNCTION cbor_extract_path(cbor, VARIADIC text[])
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_extract_path(cbor, text[]) IS 'get value from cbor with path elements';
+
+CREATE FUNCTION cbor_extract_path_text(cbor, VARIADIC text[])
+RETURNS text
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_extract_path_text(cbor, text[]) IS 'get value from cbor as text with path elements';
+
+CREATE OPERATOR -> (
+	LEFTARG = cbor, RIGHTARG = text, PROCEDURE = cbor_object_field
+);
+
+CREATE OPERATOR ->> (
+	LEFTARG = cbor, RIGHTARG = text, PROCEDURE = cbor_object_field_text
+);
+
+CREATE OPERATOR -> (
+	LEFTARG = cbor, RIGHTARG = int4, PROCEDURE = cbor_array_element
+);
+
+CREATE OPERATOR ->> (
+	LEFTARG = cbor, RIGHTARG = int4, PROCEDURE = cbor_array_element_text
+);
+
+CREATE OPERATOR #> (
+	LEFTARG = cbor, RIGHTARG = text[], PROCEDURE = cbor_extract_path
+);
+
+CREATE OPERATOR #>> (
+	LEFTARG = cbor, RIGHTARG = text[], PROCEDURE = cbor_extract_path_text
+);
+
+-- planner support functions are supported from PostgreSQL 12 on
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::int >= 120000 THEN
+		CREATE FUNCTION cbor_path_support(internal)
+		RETURNS internal
+		AS 'cbor'
+		LANGUAGE C IMMUTABLE STRICT;
+
+		CREATE FUNCTION cbor_contains_support(internal)
+		RETURNS internal
+		AS 'cbor'
+		LANGUAGE C IMMUTABLE STRICT;
+
+		CREATE FUNCTION cbor_contained_support(internal)
+		RETURNS internal
+		AS 'cbor'
+		LANGUAGE C IMMUTABLE STRICT;
+
+		ALTER FUNCTION cbor_object_field(cbor, text) SUPPORT cbor_path_support;
+		ALTER FUNCTION cbor_object_field_text(cbor, text) SUPPORT cbor_path_support;
+		ALTER FUNCTION cbor_extract_path(cbor, text[]) SUPPORT cbor_path_support;
+		ALTER FUNCTION cbor_extract_path_text(cbor, text[]) SUPPORT cbor_path_support;
+		ALTER FUNCTION cbor_contains(cbor, cbor) SUPPORT cbor_contains_support;
+		ALTER FUNCTION cbor_contained(cbor, cbor) SUPPORT cbor_contained_support;
+	END IF;
+END;
+$$;
+
+
+-- modification functions
+
+CREATE FUNCTION cbor_set(cbor, text[], cbor, create_missing bool DEFAULT true)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_set(cbor, text[], cbor, bool) IS 'replace value at path in cbor';
+
+CREATE FUNCTION cbor_delete(cbor, text)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_delete(cbor, text) IS 'delete cbor map key or matching array elements';
+
+CREATE FUNCTION cbor_delete(cbor, int4)
+RETURNS cbor
+AS 'cbor', 'cbor_delete_idx'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_delete(cbor, int4) IS 'delete cbor array element or map integer key';
+
+CREATE FUNCTION cbor_delete_path(cbor, text[])
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_delete_path(cbor, text[]) IS 'delete value at path in cbor';
+
+CREATE FUNCTION cbor_concat(cbor, cbor)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_concat(cbor, cbor) IS 'concatenate cbor arrays or merge cbor maps';
+
+CREATE OPERATOR - (
+	LEFTARG = cbor, RIGHTARG = text, PROCEDURE = cbor_delete
+);
+
+CREATE OPERATOR - (
+	LEFTARG = cbor, RIGHTARG = int4, PROCEDURE = cbor_delete
+);
+
+CREATE OPERATOR #- (
+	LEFTARG = cbor, RIGHTARG = text[], PROCEDURE = cbor_delete_path
+);
+
+CREATE OPERATOR || (
+	LEFTARG = cbor, RIGHTARG = cbor, PROCEDURE = cbor_concat
+);
+
+
+-- jsonb conversion
+
+CREATE FUNCTION cbor_to_jsonb(cbor)
+RETURNS jsonb
+AS 'cbor'
+LANGUAGE C STABLE STRICT;
+
+COMMENT ON FUNCTION cbor_to_jsonb(cbor) IS 'convert cbor to jsonb';
+
+CREATE FUNCTION jsonb_to_cbor(jsonb)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION jsonb_to_cbor(jsonb) IS 'convert jsonb to cbor';
+
+CREATE CAST (cbor AS jsonb) WITH FUNCTION cbor_to_jsonb(cbor);
+CREATE CAST (jsonb AS cbor) WITH FUNCTION jsonb_to_cbor(jsonb);
+
+
+-- typed extraction
+
+CREATE FUNCTION cbor_to_int8(cbor)
+RETURNS int8
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_to_int8(cbor) IS 'extract an integer or rounded float from cbor';
+
+CREATE FUNCTION cbor_to_float8(cbor)
+RETURNS float8
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_to_float8(cbor) IS 'extract an integer or float from cbor';
+
+CREATE FUNCTION cbor_to_bytea(cbor)
+RETURNS bytea
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_to_bytea(cbor) IS 'extract a byte string from cbor';
+
+CREATE FUNCTION cbor_to_timestamptz(cbor)
+RETURNS timestamptz
+AS 'cbor'
+LANGUAGE C STABLE STRICT;
+
+COMMENT ON FUNCTION cbor_to_timestamptz(cbor) IS 'extract a datetime of tag 0 or 1 from cbor';
+
+CREATE CAST (cbor AS int8) WITH FUNCTION cbor_to_int8(cbor);
+CREATE CAST (cbor AS float8) WITH FUNCTION cbor_to_float8(cbor);
+CREATE CAST (cbor AS bytea) WITH FUNCTION cbor_to_bytea(cbor);
+CREATE CAST (cbor AS timestamptz) WITH FUNCTION cbor_to_timestamptz(cbor);
+
+
+-- set returning functions
+
+CREATE FUNCTION cbor_array_elements(cbor)
+RETURNS SETOF cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_array_elements(cbor) IS 'elements of a cbor array';
+
+CREATE FUNCTION cbor_each(cbor, OUT key text, OUT value cbor)
+RETURNS SETOF record
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_each(cbor) IS 'key and value pairs of a cbor map';
+
+CREATE FUNCTION cbor_object_keys(cbor)
+RETURNS SETOF text
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+COMMENT ON FUNCTION cbor_object_keys(cbor) IS 'keys of a cbor map';
+
+--
+-- raw storage type
+--
+
+CREATE FUNCTION cbor_raw_in(cstring)
+RETURNS cbor_raw
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION cbor_raw_out(cbor_raw)
+RETURNS cstring
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION cbor_raw_recv(internal)
+RETURNS cbor_raw
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION cbor_raw_send(cbor_raw)
+RETURNS bytea
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE TYPE cbor_raw (
+	INTERNALLENGTH = variable,
+	INPUT = cbor_raw_in,
+	OUTPUT = cbor_raw_out,
+	RECEIVE = cbor_raw_recv,
+	SEND = cbor_raw_send,
+	STORAGE = extended
+);
+
+COMMENT ON TYPE cbor_raw IS 'Concise Binary Object Representation stored in its encoded form';
+
+CREATE FUNCTION cbor_raw_to_cbor(cbor_raw)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION cbor_to_cbor_raw(cbor)
+RETURNS cbor_raw
+AS 'cbor', 'cbor_encode'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE CAST (cbor_raw AS cbor) WITH FUNCTION cbor_raw_to_cbor(cbor_raw) AS IMPLICIT;
+CREATE CAST (cbor AS cbor_raw) WITH FUNCTION cbor_to_cbor_raw(cbor) AS ASSIGNMENT;
+
+--
+-- aggregates
+--
+
+CREATE FUNCTION cbor_agg_transfn(internal, anyelement)
+RETURNS internal
+AS 'cbor'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION cbor_agg_finalfn(internal)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION cbor_map_agg_transfn(internal, "any", "any")
+RETURNS internal
+AS 'cbor'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION cbor_map_agg_finalfn(internal)
+RETURNS cbor
+AS 'cbor'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION cbor_agg_combinefn(internal, internal)
+RETURNS internal
+AS 'cbor'
+LANGUAGE C IMMUTABLE;
+
+CREATE FUNCTION cbor_agg_serialize(internal)
+RETURNS bytea
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+CREATE FUNCTION cbor_agg_deserialize(bytea, internal)
+RETURNS internal
+AS 'cbor'
+LANGUAGE C IMMUTABLE STRICT;
+
+-- parallel aggregation is supported from PostgreSQL 9.6 on
+DO $$
+BEGIN
+	IF current_setting('server_version_num')::int >= 90600 THEN
+		ALTER FUNCTION cbor_agg_transfn(internal, anyelement) PARALLEL SAFE;
+		ALTER FUNCTION cbor_agg_finalfn(internal) PARALLEL SAFE;
+		ALTER FUNCTION cbor_map_agg_transfn(internal, "any", "any") PARALLEL SAFE;
+		ALTER FUNCTION cbor_map_agg_finalfn(internal) PARALLEL SAFE;
+		ALTER FUNCTION cbor_agg_combinefn(internal, internal) PARALLEL SAFE;
+		ALTER FUNCTION cbor_agg_serialize(internal) PARALLEL SAFE;
+		ALTER FUNCTION cbor_agg_deserialize(bytea, internal) PARALLEL SAFE;
+
+		CREATE AGGREGATE cbor_agg(anyelement) (
+			SFUNC = cbor_agg_transfn,
+			STYPE = internal,
+			FINALFUNC = cbor_agg_finalfn,
+			COMBINEFUNC = cbor_agg_combinefn,
+			SERIALFUNC = cbor_agg_serialize,
+			DESERIALFUNC = cbor_agg_deserialize,
+			PARALLEL = SAFE
+		);
+
+		CREATE AGGREGATE cbor_map_agg("any", "any") (
+			SFUNC = cbor_map_agg_transfn,
+			STYPE = internal,
+			FINALFUNC = cbor_map_agg_finalfn,
+			COMBINEFUNC = cbor_agg_combinefn,
+			SERIALFUNC = cbor_agg_serialize,
+			DESERIALFUNC = cbor_agg_deserialize,
+			PARALLEL = SAFE
+		);
+	ELSE
+		CREATE AGGREGATE cbor_agg(anyelement) (
+			SFUNC = cbor_agg_transfn,
+			STYPE = internal,
+			FINALFUNC = cbor_agg_finalfn
+		);
+
+		CREATE AGGREGATE cbor_map_agg("any", "any") (
+			SFUNC = cbor_map_agg_transfn,
+			STYPE = internal,
+			FINALFUNC = cbor_map_agg_finalfn
+		);
+	END IF;
+END;
+$$;
+
+COMMENT ON AGGREGATE cbor_agg(anyelement) IS 'collect all input values into a cbor array';
+COMMENT ON AGGREGATE cbor_map_agg("any", "any") IS 'collect all key and value pairs into a cbor map';
+
+--
+-- statistics
+--
+
+CREATE FUNCTION cbor_stats(OUT operation text, OUT calls bigint, OUT bytes bigint, OUT items bigint, OUT max_depth integer, OUT total_time double precision)
+RETURNS SETOF record
+AS 'cbor'
+LANGUAGE C VOLATILE STRICT;
+
+COMMENT ON FUNCTION cbor_stats() IS 'work done by cbor functions in this session while cbor.track_stats is on';
+
+CREATE FUNCTION cbor_stats_reset()
+RETURNS void
+AS 'cbor'
+LANGUAGE C VOLATILE STRICT;
+
+COMMENT ON FUNCTION cbor_stats_reset() IS 'reset the counters shown by cbor_stats';
@@ -2,73 +2,148 @@
 #define __CBOR_H__
 
 #include "postgres.h"
+#include "cbor_core.h"
+#include "fmgr.h"
+#include "lib/stringinfo.h"
+#include "portability/instr_time.h"
+#include "utils/numeric.h"
+#if PG_VERSION_NUM >= 90500
+#include "utils/expandeddatum.h"
+#endif
 
-typedef uint32 CborEntry;
-
-#define CBORENTRY_POSMASK 0x1FFFFFFF
-#define CBORENTRY_TYPEMASK 0xE0000000
-
-#define CBORENTRY_TYPE_UNSIGNEDINTEGER 0x00000000
-#define CBORENTRY_TYPE_NEGATIVEINTEGER 0x20000000
-#define CBORENTRY_TYPE_BYTESTRING 0x40000000
-#define CBORENTRY_TYPE_TEXTSTRING 0x60000000
-#define CBORENTRY_TYPE_ARRAY 0x80000000
-#define CBORENTRY_TYPE_MAP 0xA0000000
-#define CBORENTRY_TYPE_TAG 0xC0000000
-#define CBORENTRY_TYPE_FLOATORSIMPLE 0xE0000000
-
-#define CBORENTRY_ENDPOS(ce_, i) ((ce_)[i] & CBORENTRY_POSMASK)
-#define CBORENTRY_OFF(ce_, i) ((i) == 0 ? 0 : CBORENTRY_ENDPOS(ce_, i-1))
-#define CBORENTRY_VALUE(ce_, i, cnt) ((void*)((char*)((ce_) + cnt) + CBORENTRY_OFF(ce_, i)))
-
-#define CBORENTRY_GETSTR(ce_, i, cnt) (((char*) CBORENTRY_VALUE(ce_, i, cnt)) + VARHDRSZ)
-#define CBORENTRY_STRLEN(ce_, i, cnt) (VARSIZE(CBORENTRY_VALUE(ce_, i, cnt)) - VARHDRSZ)
-#define CBORENTRY_SETSTRLEN(ce_, i, cnt, len) SET_VARSIZE(CBORENTRY_VALUE(ce_, i, cnt), VARHDRSZ + len)
-
-#define CBOR_SIMPLE_VALUE 0x7FFFFFFFFFFFFF00
-#define CBOR_SIMPLEMASK   0xFFFFFFFFFFFFFF00
-
-#define CBORENTRY_INDEFINITE 0x1F
-#define CBORENTRY_BREAK 0xFF
-
-typedef struct CborContainer
+/*
+ * A value being modified is held as a tree of CborNodes, which keeps all
+ * parts it has not descended into as references to their flat bytes.  Only
+ * arrays and maps on a modified path are expanded into their items, maps
+ * with keys and values alternating in the original order.  Flattening the
+ * tree copies the referenced parts verbatim and only rewrites the entries
+ * of expanded containers.  A node that was set to a new value owns the copy
+ * of it, which the flat values of its items refer to, and frees it together
+ * with its items once it is replaced or removed.
+ */
+typedef struct CborNode
 {
-	int32		count;
-	CborEntry	entries[1];
-}	CborContainer;
-
-typedef struct CborTag
+	CborEntry	type;
+	CborEntry  *entry;			/* the flat value, NULL once expanded */
+	int32		nr;
+	int32		cnt;
+	int32		count;			/* number of items */
+	int32		allocated;
+	struct CborNode *items;
+	Cbor	   *owned;			/* copy owned by the node, or NULL */
+}	CborNode;
+
+/*
+ * From PostgreSQL 9.5 on an ExpandedCbor is an expanded object, which is
+ * passed between functions by reference and only flattened when stored.
+ * Before that it is flattened when returned.
+ */
+typedef struct ExpandedCbor
 {
-	uint64		value;
-	CborEntry	entry;
-}	CborTag;
-
-typedef struct Cbor
+#if PG_VERSION_NUM >= 90500
+	ExpandedObjectHeader hdr;
+#endif
+	MemoryContext context;
+	CborNode	root;
+	Size		flat_size;		/* size of the flattened value, or 0 */
+}	ExpandedCbor;
+
+/*
+ * Counters of the work of this backend, which are only updated while
+ * cbor.track_stats is on.
+ */
+typedef struct CborStatsCounter
 {
-	/* varlena header (do not touch directly!) */
-	int32		vl_len_;
-	CborEntry	root;
-}	Cbor;
+	int64		calls;
+	int64		bytes;
+	instr_time	time;
+}	CborStatsCounter;
 
-typedef struct CborValue
+typedef struct CborStats
 {
-	CborEntry	type;
-
-	union
+	CborStatsCounter decode;	/* binary input, bytes read */
+	CborStatsCounter encode;	/* binary output, bytes written */
+	CborStatsCounter output;	/* text output, bytes written */
+	CborStatsCounter compare;	/* comparisons, bytes fetched */
+	CborStatsCounter detoast;	/* copies of toasted or short values */
+	CborCoreStats core;
+}	CborStats;
+
+extern bool cbor_track_stats;
+extern CborStats cbor_counters;
+
+/*
+ * Count a call on nbytes bytes and, if start is given, the time since then.
+ */
+static inline void
+cbor_stats_add(CborStatsCounter * counter, Size nbytes, instr_time *start)
+{
+	counter->calls++;
+	counter->bytes += nbytes;
+	if (start)
 	{
-		uint64		uint;
-		double		flt;
-		int32		length;
-	}			value;
+		instr_time	now;
 
-	struct CborValue *child;
-	struct CborValue *next;
+		INSTR_TIME_SET_CURRENT(now);
+		INSTR_TIME_ACCUM_DIFF(counter->time, now, *start);
+	}
+}
 
-}	CborValue;
+static inline struct varlena *
+cbor_detoast_datum(Datum datum)
+{
+	struct varlena *result = PG_DETOAST_DATUM(datum);
 
+	if (cbor_track_stats && (Pointer) result != DatumGetPointer(datum))
+		cbor_stats_add(&cbor_counters.detoast, VARSIZE(result), NULL);
+	return result;
+}
 
 #define DatumGetCbor(x) ((Cbor*)DatumGetPointer(x))
-#define PG_GETARG_CBOR(x)	DatumGetCbor(PG_DETOAST_DATUM(PG_GETARG_DATUM(x)) )
+#define PG_GETARG_CBOR(x)	DatumGetCbor(cbor_detoast_datum(PG_GETARG_DATUM(x)) )
 #define PG_RETURN_CBOR(x)	PG_RETURN_POINTER(x)
 
+
+#define CborContainsStrategyNumber 7
+
+/* values of cbor.jsonb_bytes */
+typedef enum
+{
+	CBOR_JSONB_BYTES_BASE64URL,
+	CBOR_JSONB_BYTES_BASE64,
+	CBOR_JSONB_BYTES_HEX
+}	CborJsonbBytes;
+
+/* values of cbor.jsonb_tags */
+typedef enum
+{
+	CBOR_JSONB_TAGS_VALUE,
+	CBOR_JSONB_TAGS_OBJECT,
+	CBOR_JSONB_TAGS_ERROR
+}	CborJsonbTags;
+
+extern int	cbor_jsonb_bytes;
+extern int	cbor_jsonb_tags;
+
+extern Cbor *cbor_from_entry(CborEntry * entry, int32 nr, int32 cnt);
+extern text *cbor_entry_to_text(CborEntry * entry, int32 nr, int32 cnt);
+extern const char *cbor_string_to_server(const char *str, int *len);
+extern void cbor_out_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt);
+extern void cbor_parse(const char *str, StringInfo out);
+extern Cbor *cbor_make_numeric(Numeric num);
+
+extern ExpandedCbor *cbor_expand(Datum datum, MemoryContext parentcontext);
+extern ExpandedCbor *DatumGetExpandedCbor(Datum datum);
+extern Datum ExpandedCborGetDatum(ExpandedCbor * ecb);
+extern void cbor_node_expand(ExpandedCbor * ecb, CborNode * node);
+extern void cbor_node_set(ExpandedCbor * ecb, CborNode * node, Cbor * value);
+extern void cbor_node_free(CborNode * node);
+extern CborNode *cbor_node_insert(ExpandedCbor * ecb, CborNode * node, int32 pos, int32 n);
+extern void cbor_node_remove(ExpandedCbor * ecb, CborNode * node, int32 pos, int32 n);
+extern int32 cbor_node_find_key(ExpandedCbor * ecb, CborNode * node, const char *key, int32 keylen);
+
+extern Datum cbor_out(PG_FUNCTION_ARGS);
+extern Datum cbor_raw_out(PG_FUNCTION_ARGS);
+extern Datum cbor_raw_to_cbor(PG_FUNCTION_ARGS);
+
 #endif
@@ -0,0 +1,1334 @@
+#include "cbor_core.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#ifdef CBOR_CORE_STANDALONE
+#include <stdlib.h>
+#else
+#include "miscadmin.h"
+#endif
+
+static int	lengthCompareCborText(const void *a, const void *b);
+static bool cbor_skip_item(const uint8 **cursor, const uint8 *end);
+static char *cbor_encode_item(char *out, CborEntry * entry, int32 nr, int32 cnt, bool canonical);
+static char *cbor_encode_canonical_map(char *out, CborContainer * value, int32 count);
+static void cbor_merge_sort(int32 * items, int32 * tmp, int32 count, int (*cmp) (int32 a, int32 b, void *arg), void *arg);
+static int	cbor_sort_map_cmp(int32 a, int32 b, void *arg);
+static int	cbor_encoded_key_cmp(int32 a, int32 b, void *arg);
+static uint64 cbor_hash_recursive(uint64 hash, CborEntry * cbor, int32 nr, int32 cnt);
+
+
+typedef enum
+{
+	CborAdditionalBytes1 = 24,
+	CborAdditionalBytes2 = 25,
+	CborAdditionalBytes4 = 26,
+	CborAdditionalBytes8 = 27
+} CborAdditionalBytes;
+
+#ifdef CBOR_CORE_STANDALONE
+
+static void
+cbor_core_default_error(CborCoreError code, const char *message)
+{
+	fprintf(stderr, "cbor: %s\n", message);
+	abort();
+}
+
+CborCoreHooks cbor_core_hooks = {malloc, realloc, free, cbor_core_default_error, NULL};
+
+#else
+
+static void
+cbor_core_default_error(CborCoreError code, const char *message)
+{
+	ereport(ERROR,
+			(errcode(code == CBOR_CORE_TOO_LARGE ? ERRCODE_PROGRAM_LIMIT_EXCEEDED :
+					 code == CBOR_CORE_OUT_OF_MEMORY ? ERRCODE_OUT_OF_MEMORY : ERRCODE_INVALID_BINARY_REPRESENTATION),
+			 errmsg("%s", message)));
+}
+
+CborCoreHooks cbor_core_hooks = {palloc, repalloc, pfree, cbor_core_default_error, check_stack_depth};
+
+#endif
+
+CborCoreStats *cbor_core_stats = NULL;
+
+void
+cbor_core_error(CborCoreError code, const char *fmt,...)
+{
+	char		message[256];
+	va_list		args;
+
+	va_start(args, fmt);
+	vsnprintf(message, sizeof(message), fmt, args);
+	va_end(args);
+
+	cbor_core_hooks.error(code, message);
+	abort();
+}
+
+static inline void *
+cbor_core_alloc(Size size)
+{
+	void	   *result = cbor_core_hooks.alloc(size);
+
+	if (!result)
+		cbor_core_error(CBOR_CORE_OUT_OF_MEMORY, "out of memory");
+	return result;
+}
+
+static inline void *
+cbor_core_realloc(void *ptr, Size size)
+{
+	void	   *result = cbor_core_hooks.realloc(ptr, size);
+
+	if (!result)
+		cbor_core_error(CBOR_CORE_OUT_OF_MEMORY, "out of memory");
+	return result;
+}
+
+static inline void
+cbor_core_free(void *ptr)
+{
+	cbor_core_hooks.free(ptr);
+}
+
+static inline void
+cbor_core_check_depth(void)
+{
+	if (cbor_core_hooks.check_depth)
+		cbor_core_hooks.check_depth();
+}
+
+/*
+ * Offsets are limited to CBORENTRY_POSMASK, which is less than the maximum
+ * size of a varlena.  No offset stored in a value exceeds its size, so
+ * checking the size of a value ensures that none of its offsets wrap.
+ */
+void
+cbor_check_size(Size size)
+{
+	if (size > CBORENTRY_POSMASK)
+		cbor_core_error(CBOR_CORE_TOO_LARGE, "cbor value exceeds the maximum size of %d bytes",
+						CBORENTRY_POSMASK);
+}
+
+static double
+cbor_decode_half(uint64 value)
+{
+	uint64		sign = value & 0x8000;
+	uint64		exponent = value & 0x7c00;
+	uint64		fraction = value & 0x03ff;
+
+	if (exponent == 0x7c00)
+		exponent = 0x7ff << 10;
+	else if (exponent)
+		exponent += (1023 - 15) << 10;
+	else if (fraction)
+		return sign ? -ldexp(fraction, -24) : ldexp(fraction, -24);
+
+	value = sign << 48 | exponent << 42 | fraction << 42;
+	return *((double *) &value);
+}
+
+/*
+ * Return the 8 byte representation of a float or simple value with the
+ * given additional information and argument.
+ */
+static uint64
+cbor_decode_float_or_simple(uint8 info, uint64 value)
+{
+	double		dbl;
+
+	if (info < CborAdditionalBytes2)
+		return CBOR_SIMPLE_VALUE | value;
+
+	if (info == CborAdditionalBytes2)
+		dbl = cbor_decode_half(value);
+	else if (info == CborAdditionalBytes4)
+	{
+		uint32		val = value;
+
+		dbl = *((float *) &val);
+	}
+	else
+		dbl = *((double *) &value);
+
+	if (isnan(dbl))
+		dbl = NAN;
+
+	return *((uint64 *) &dbl);
+}
+
+/*
+ * The binary decoder works in two passes over the input.  cbor_scan_item
+ * validates the input and computes the exact size of the decoded value, so
+ * the result can be allocated at once.  cbor_write_item then fills it
+ * without any further checks.  The lengths of indefinite arrays and maps
+ * are remembered by the first pass in the order they are encountered.
+ * The first pass also counts the items and the nesting depth for
+ * cbor_core_stats.
+ */
+typedef struct CborDecodeState
+{
+	const uint8 *cursor;
+	const uint8 *end;
+	char	   *out;
+	int32	   *counts;
+	int32		ncounts;
+	int32		maxcounts;
+	int32		nextcount;
+	int32		maxdepth;
+	uint64		items;
+	int32		countsbuf[16];
+}	CborDecodeState;
+
+static inline uint64
+cbor_read_uint(const uint8 *data, int bytes)
+{
+	uint64		value = 0;
+
+	while (bytes--)
+		value = (value << 8) | *data++;
+	return value;
+}
+
+/*
+ * Read the initial byte and the argument of the next item.  The argument is
+ * zero for indefinite lengths and the additional information is returned
+ * in info.
+ */
+static inline uint64
+cbor_scan_header(CborDecodeState * state, uint8 *info)
+{
+	uint8		first_byte;
+	int			bytes;
+	uint64		value;
+
+	if (state->cursor >= state->end)
+		cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+
+	first_byte = *state->cursor++;
+	*info = first_byte & 0x1f;
+
+	if (*info < CborAdditionalBytes1)
+		return *info;
+	if (*info == CBORENTRY_INDEFINITE)
+		return 0;
+	if (*info > CborAdditionalBytes8)
+		cbor_core_error(CBOR_CORE_INVALID_INPUT, "invalid length type (%d)", *info);
+
+	bytes = 1 << (*info - CborAdditionalBytes1);
+	if (state->end - state->cursor < bytes)
+		cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+
+	value = cbor_read_uint(state->cursor, bytes);
+	state->cursor += bytes;
+	return value;
+}
+
+static inline uint64
+cbor_write_header(CborDecodeState * state, uint8 *info)
+{
+	uint8		first_byte = *state->cursor++;
+	int			bytes;
+	uint64		value;
+
+	*info = first_byte & 0x1f;
+	if (*info < CborAdditionalBytes1)
+		return *info;
+	if (*info == CBORENTRY_INDEFINITE)
+		return 0;
+
+	bytes = 1 << (*info - CborAdditionalBytes1);
+	value = cbor_read_uint(state->cursor, bytes);
+	state->cursor += bytes;
+	return value;
+}
+
+static Size
+cbor_scan_item(CborDecodeState * state, int32 depth)
+{
+	uint8		info;
+	CborEntry	type;
+	uint64		value;
+	uint64		i;
+	Size		size;
+
+	cbor_core_check_depth();
+
+	state->items++;
+	if (depth > state->maxdepth)
+		state->maxdepth = depth;
+
+	if (state->cursor >= state->end)
+		cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+	if (*state->cursor == CBORENTRY_BREAK)
+		cbor_core_error(CBOR_CORE_INVALID_INPUT, "unexpected break");
+
+	type = ((CborEntry) *state->cursor << 24) & CBORENTRY_TYPEMASK;
+	value = cbor_scan_header(state, &info);
+
+	if (info == CBORENTRY_INDEFINITE && (type == CBORENTRY_TYPE_UNSIGNEDINTEGER || type == CBORENTRY_TYPE_NEGATIVEINTEGER || type == CBORENTRY_TYPE_TAG || type == CBORENTRY_TYPE_FLOATORSIMPLE))
+		cbor_core_error(CBOR_CORE_INVALID_INPUT, "type %d does not support indefinite values", type >> 29);
+
+	switch (type)
+	{
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			if (info == CBORENTRY_INDEFINITE)
+			{
+				while (state->cursor < state->end && *state->cursor != CBORENTRY_BREAK)
+				{
+					uint64		len;
+
+					if ((((CborEntry) *state->cursor << 24) & CBORENTRY_TYPEMASK) != type)
+						cbor_core_error(CBOR_CORE_INVALID_INPUT, "invalid type %d in indefinite value of type %d", *state->cursor >> 5, type >> 29);
+
+					len = cbor_scan_header(state, &info);
+					if (info == CBORENTRY_INDEFINITE)
+						cbor_core_error(CBOR_CORE_INVALID_INPUT, "indefinite value in indefinite value of type %d", type >> 29);
+					if (len > state->end - state->cursor)
+						cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+
+					state->cursor += len;
+					value += len;
+				}
+				if (state->cursor++ >= state->end)
+					cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+			}
+			else
+			{
+				if (value > state->end - state->cursor)
+					cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+				state->cursor += value;
+			}
+			return INTALIGN(VARHDRSZ + value);
+
+		case CBORENTRY_TYPE_ARRAY:
+		case CBORENTRY_TYPE_MAP:
+			{
+				int			items = type == CBORENTRY_TYPE_MAP ? 2 : 1;
+
+				if (info == CBORENTRY_INDEFINITE)
+				{
+					int32		slot;
+
+					if (state->ncounts == state->maxcounts)
+					{
+						state->maxcounts *= 2;
+						if (state->counts == state->countsbuf)
+						{
+							state->counts = cbor_core_alloc(state->maxcounts * sizeof(int32));
+							memcpy(state->counts, state->countsbuf, sizeof(state->countsbuf));
+						}
+						else
+							state->counts = cbor_core_realloc(state->counts, state->maxcounts * sizeof(int32));
+					}
+					slot = state->ncounts++;
+
+					size = 0;
+					while (state->cursor < state->end && *state->cursor != CBORENTRY_BREAK)
+					{
+						size += cbor_scan_item(state, depth + 1);
+						value += 1;
+					}
+					if (state->cursor++ >= state->end)
+						cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+					if (value % items)
+						cbor_core_error(CBOR_CORE_INVALID_INPUT, "missing value in indefinite map");
+
+					value /= items;
+					state->counts[slot] = value;
+				}
+				else
+				{
+					/* every item needs at least one byte */
+					if (value > (state->end - state->cursor) / items)
+						cbor_core_error(CBOR_CORE_INVALID_INPUT, "insufficient data left in message");
+
+					size = 0;
+					for (i = 0; i < value * items; ++i)
+						size += cbor_scan_item(state, depth + 1);
+				}
+
+				size += sizeof(int32) + value * items * sizeof(CborEntry);
+				if (type == CBORENTRY_TYPE_MAP)
+					size += CBORCONTAINER_SORTSIZE(value);
+				return size;
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			return sizeof(uint64) + sizeof(CborEntry) + cbor_scan_item(state, depth + 1);
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			value = cbor_decode_float_or_simple(info, value);
+			break;
+	}
+
+	return cbor_put_scalar(NULL, type, value);
+}
+
+static CborEntry
+cbor_write_item(CborDecodeState * state, char *base)
+{
+	uint8		info;
+	CborEntry	type = ((CborEntry) *state->cursor << 24) & CBORENTRY_TYPEMASK;
+	uint64		value = cbor_write_header(state, &info);
+	char	   *data = state->out;
+	int32		i;
+
+	switch (type)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			state->out += cbor_put_scalar(data, type, value);
+			break;
+
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			{
+				char	   *target = VARDATA(data);
+
+				if (info == CBORENTRY_INDEFINITE)
+				{
+					while (*state->cursor != CBORENTRY_BREAK)
+					{
+						uint64		len = cbor_write_header(state, &info);
+
+						memcpy(target + value, state->cursor, len);
+						state->cursor += len;
+						value += len;
+					}
+					state->cursor++;
+				}
+				else
+				{
+					memcpy(target, state->cursor, value);
+					state->cursor += value;
+				}
+
+				SET_VARSIZE(data, VARHDRSZ + value);
+				state->out += INTALIGN(VARHDRSZ + value);
+				memset(target + value, 0, state->out - target - value);
+				break;
+			}
+
+		case CBORENTRY_TYPE_ARRAY:
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *container = (CborContainer *) data;
+				int32		count;
+				char	   *values;
+
+				if (info == CBORENTRY_INDEFINITE)
+					value = state->counts[state->nextcount++];
+
+				count = value * (type == CBORENTRY_TYPE_MAP ? 2 : 1);
+				container->count = value;
+				values = (char *) (container->entries + count);
+				state->out = values;
+
+				for (i = 0; i < count; ++i)
+					container->entries[i] = cbor_write_item(state, values);
+
+				if (info == CBORENTRY_INDEFINITE)
+					state->cursor++;
+
+				if (type == CBORENTRY_TYPE_MAP)
+					state->out += cbor_sort_map(container);
+				break;
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *tag = (CborTag *) data;
+
+				tag->value = value;
+				state->out += sizeof(uint64) + sizeof(CborEntry);
+				tag->entry = cbor_write_item(state, state->out);
+				break;
+			}
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			state->out += cbor_put_scalar(data, type, cbor_decode_float_or_simple(info, value));
+			break;
+	}
+
+	return type | (state->out - base);
+}
+
+static void
+cbor_decode_init(CborDecodeState * state, const uint8 *data, Size len)
+{
+	state->cursor = data;
+	state->end = data + len;
+	state->counts = state->countsbuf;
+	state->ncounts = 0;
+	state->maxcounts = lengthof(state->countsbuf);
+	state->nextcount = 0;
+	state->maxdepth = 0;
+	state->items = 0;
+}
+
+/*
+ * Decode the first item of the len bytes at data into a newly allocated
+ * value and store the number of bytes it takes in consumed.
+ */
+Cbor *
+cbor_core_decode(const uint8 *data, Size len, Size *consumed)
+{
+	CborDecodeState state;
+	Size		size;
+	Cbor	   *result;
+
+	cbor_decode_init(&state, data, len);
+
+	size = cbor_scan_item(&state, 1);
+	cbor_check_size(size);
+	size += offsetof(Cbor, root) + sizeof(CborEntry);
+
+	result = cbor_core_alloc(size);
+	SET_VARSIZE(result, size);
+
+	state.cursor = data;
+	state.out = (char *) (&result->root + 1);
+	result->root = cbor_write_item(&state, state.out);
+
+	if (consumed)
+		*consumed = state.cursor - data;
+
+	if (cbor_core_stats)
+	{
+		cbor_core_stats->items += state.items;
+		cbor_core_stats->max_depth = Max(cbor_core_stats->max_depth, state.maxdepth);
+	}
+
+	if (state.counts != state.countsbuf)
+		cbor_core_free(state.counts);
+
+	return result;
+}
+
+/*
+ * Validate the first item of the len bytes at data without decoding it and
+ * return the number of bytes it takes.
+ */
+Size
+cbor_core_scan(const uint8 *data, Size len)
+{
+	CborDecodeState state;
+
+	cbor_decode_init(&state, data, len);
+	cbor_scan_item(&state, 1);
+
+	if (state.counts != state.countsbuf)
+		cbor_core_free(state.counts);
+
+	return state.cursor - data;
+}
+
+/*
+ * Return whether the len bytes at data hold a complete first item, so input
+ * read in chunks can be decoded once enough of it has arrived.  Only the
+ * headers are followed.  Invalid headers count as complete and are left for
+ * the decoder to report.
+ */
+bool
+cbor_core_complete(const uint8 *data, Size len)
+{
+	return cbor_skip_item(&data, data + len);
+}
+
+static bool
+cbor_skip_item(const uint8 **cursor, const uint8 *end)
+{
+	uint8		type;
+	uint8		info;
+	uint64		value = 0;
+	uint64		i;
+
+	cbor_core_check_depth();
+
+	if (*cursor >= end)
+		return false;
+
+	type = **cursor >> 5;
+	info = **cursor & 0x1f;
+	++*cursor;
+
+	if (info < CborAdditionalBytes1)
+		value = info;
+	else if (info <= CborAdditionalBytes8)
+	{
+		int			bytes = 1 << (info - CborAdditionalBytes1);
+
+		if (end - *cursor < bytes)
+			return false;
+		value = cbor_read_uint(*cursor, bytes);
+		*cursor += bytes;
+	}
+	else if (info != CBORENTRY_INDEFINITE || type < 2 || type == 6 || type == 7)
+		return true;
+
+	switch (type)
+	{
+		case 2:
+		case 3:
+		case 4:
+		case 5:
+			if (info == CBORENTRY_INDEFINITE)
+			{
+				for (;;)
+				{
+					if (*cursor >= end)
+						return false;
+					if (**cursor == CBORENTRY_BREAK)
+					{
+						++*cursor;
+						return true;
+					}
+					if (!cbor_skip_item(cursor, end))
+						return false;
+				}
+			}
+			if (type < 4)
+			{
+				if (value > end - *cursor)
+					return false;
+				*cursor += value;
+				return true;
+			}
+			/* every item needs at least one byte */
+			if (value > (end - *cursor) / (type == 5 ? 2 : 1))
+				return false;
+			for (i = 0; i < value * (type == 5 ? 2 : 1); ++i)
+			{
+				if (!cbor_skip_item(cursor, end))
+					return false;
+			}
+			return true;
+
+		case 6:
+			return cbor_skip_item(cursor, end);
+	}
+
+	return true;
+}
+
+/*
+ * The binary encoder works in two passes as well.  cbor_core_encoded_size
+ * computes the exact length of the encoded value, so the result can be
+ * allocated at once, and cbor_core_encode writes the headers directly into
+ * it and returns the end of the written bytes.  cbor_core_encode_canonical
+ * writes the pairs of maps ordered bytewise by their encoded keys instead
+ * of their original order, which together with the shortest form of
+ * numbers and definite lengths makes equal values encode to identical
+ * bytes, see RFC 8949 section 4.2.1.  The order does not change the size.
+ */
+static inline Size
+cbor_header_size(uint64 value)
+{
+	if (value < CborAdditionalBytes1)
+		return 1;
+	if (value <= 0xff)
+		return 2;
+	if (value <= 0xffff)
+		return 3;
+	if (value <= 0xffffffff)
+		return 5;
+	return 9;
+}
+
+static inline char *
+cbor_write_uint(char *out, uint64 value, int bytes)
+{
+	switch (bytes)
+	{
+		case 8:
+			out[0] = (char) (value >> 56);
+			out[1] = (char) (value >> 48);
+			out[2] = (char) (value >> 40);
+			out[3] = (char) (value >> 32);
+			out += 4;
+			/* FALLTHROUGH */
+		case 4:
+			out[0] = (char) (value >> 24);
+			out[1] = (char) (value >> 16);
+			out += 2;
+			/* FALLTHROUGH */
+		case 2:
+			out[0] = (char) (value >> 8);
+			out += 1;
+			/* FALLTHROUGH */
+		case 1:
+			out[0] = (char) value;
+			out += 1;
+	}
+	return out;
+}
+
+static inline char *
+cbor_write_type_and_value(char *out, uint8 first_byte, uint64 value)
+{
+	if (value < CborAdditionalBytes1)
+	{
+		*out++ = (char) (first_byte | (uint8) value);
+		return out;
+	}
+	if (value <= 0xff)
+	{
+		*out++ = (char) (first_byte | CborAdditionalBytes1);
+		return cbor_write_uint(out, value, 1);
+	}
+	if (value <= 0xffff)
+	{
+		*out++ = (char) (first_byte | CborAdditionalBytes2);
+		return cbor_write_uint(out, value, 2);
+	}
+	if (value <= 0xffffffff)
+	{
+		*out++ = (char) (first_byte | CborAdditionalBytes4);
+		return cbor_write_uint(out, value, 4);
+	}
+	*out++ = (char) (first_byte | CborAdditionalBytes8);
+	return cbor_write_uint(out, value, 8);
+}
+
+/*
+ * Find the shortest floating point format which represents the double with
+ * the given bits exactly.  Returns the number of bytes and stores the bits
+ * of the narrowed value in encoded.
+ */
+static int
+cbor_float_width(uint64 value, uint64 *encoded)
+{
+#define DBL_BASE_EXPONENT 1023
+#define DBL_EXPONENT(exp) (((uint64)(DBL_BASE_EXPONENT + (exp))) << 52)
+
+	uint64		sign = value & 0x8000000000000000;
+	uint64		exponent = value & 0x7FF0000000000000;
+	uint64		fraction = value & 0x000FFFFFFFFFFFFF;
+	bool		is_max_exponent = exponent == DBL_EXPONENT(1024);
+
+	if (!exponent && !fraction)
+	{
+		*encoded = sign >> 48;
+		return 2;
+	}
+	else if (fraction & 0x000000001FFFFFFF || (!is_max_exponent && (exponent < DBL_EXPONENT(-126) || DBL_EXPONENT(127) < exponent)))
+	{
+		*encoded = value;
+		return 8;
+	}
+	else if (fraction & 0x000003FFFFFFFFFF || (!is_max_exponent && (exponent < DBL_EXPONENT(-14) || DBL_EXPONENT(15) < exponent)))
+	{
+		if (is_max_exponent)
+			exponent = 0xFF << 23;
+		else
+			exponent = (exponent - DBL_EXPONENT(-127)) >> 29;
+		*encoded = (sign >> 32) | exponent | (fraction >> 29);
+		return 4;
+	}
+	else
+	{
+		if (is_max_exponent)
+			exponent = 0x1F << 10;
+		else
+			exponent = (exponent - DBL_EXPONENT(-15)) >> 42;
+		*encoded = (sign >> 48) | exponent | (fraction >> 42);
+		return 2;
+	}
+}
+
+Size
+cbor_core_encoded_size(CborEntry * entry, int32 nr, int32 cnt)
+{
+	Size		size;
+	int32		i;
+
+	cbor_core_check_depth();
+
+	switch (*(entry + nr) & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			return cbor_header_size(cbor_get_scalar(entry, nr, cnt));
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			{
+				int32		len = CBORENTRY_STRLEN(entry, nr, cnt);
+
+				return cbor_header_size(len) + len;
+			}
+		case CBORENTRY_TYPE_ARRAY:
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count = CBORCONTAINER_COUNT(value);
+				int32		n = (*(entry + nr) & CBORENTRY_TYPEMASK) == CBORENTRY_TYPE_MAP ? count * 2 : count;
+
+				/* the order of map pairs does not change the size */
+				size = cbor_header_size(count);
+				for (i = 0; i < n; ++i)
+					size += cbor_core_encoded_size(value->entries, i, n);
+				return size;
+			}
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				return cbor_header_size(value->value) + cbor_core_encoded_size(&value->entry, 0, 1);
+			}
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			{
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
+				uint64		encoded;
+
+				if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+					return cbor_header_size(value & 0xFF);
+				return 1 + cbor_float_width(value, &encoded);
+			}
+	}
+	return 0;
+}
+
+char *
+cbor_core_encode(char *out, CborEntry * entry, int32 nr, int32 cnt)
+{
+	return cbor_encode_item(out, entry, nr, cnt, false);
+}
+
+char *
+cbor_core_encode_canonical(char *out, CborEntry * entry, int32 nr, int32 cnt)
+{
+	return cbor_encode_item(out, entry, nr, cnt, true);
+}
+
+static char *
+cbor_encode_item(char *out, CborEntry * entry, int32 nr, int32 cnt, bool canonical)
+{
+	int32		i;
+	uint8		type = *(entry + nr) >> 24;
+
+	switch (*(entry + nr) & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			{
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
+
+				return cbor_write_type_and_value(out, type, value);
+			}
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			{
+				int32		len = CBORENTRY_STRLEN(entry, nr, cnt);
+
+				out = cbor_write_type_and_value(out, type, len);
+				memcpy(out, CBORENTRY_GETSTR(entry, nr, cnt), len);
+				return out + len;
+			}
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				out = cbor_write_type_and_value(out, type, value->count);
+				for (i = 0; i < value->count; ++i)
+					out = cbor_encode_item(out, value->entries, i, value->count, canonical);
+				return out;
+			}
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count = CBORCONTAINER_COUNT(value);
+				uint32	   *order = CBORCONTAINER_IS_SORTED(value) ? CBORCONTAINER_ORDER(value) : NULL;
+
+				out = cbor_write_type_and_value(out, type, count);
+				if (canonical)
+					return cbor_encode_canonical_map(out, value, count);
+
+				for (i = 0; i < count; ++i)
+				{
+					int32		pair = order ? order[i] : i;
+
+					out = cbor_encode_item(out, value->entries, pair * 2 + 0, count * 2, false);
+					out = cbor_encode_item(out, value->entries, pair * 2 + 1, count * 2, false);
+				}
+				return out;
+			}
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				out = cbor_write_type_and_value(out, type, value->value);
+				return cbor_encode_item(out, &value->entry, 0, 1, canonical);
+			}
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			{
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
+				uint64		encoded;
+				int			bytes;
+
+				if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+					return cbor_write_type_and_value(out, type, value & 0xFF);
+
+				bytes = cbor_float_width(value, &encoded);
+				*out++ = (char) (type | (bytes == 2 ? CborAdditionalBytes2 : bytes == 4 ? CborAdditionalBytes4 : CborAdditionalBytes8));
+				return cbor_write_uint(out, encoded, bytes);
+			}
+	}
+	return out;
+}
+
+/*
+ * The pairs of a map being written canonically: the offsets of their
+ * encoded keys from data and the end of the last value at start[count].
+ */
+typedef struct CborEncodedMap
+{
+	char	   *data;
+	Size	   *start;
+	Size	   *keyend;
+}	CborEncodedMap;
+
+/*
+ * Write the pairs of a map ordered bytewise by their encoded keys.  They are
+ * written in the order of the entries first, which keeps duplicate keys in
+ * their original order, and then moved into place.
+ */
+static char *
+cbor_encode_canonical_map(char *out, CborContainer * value, int32 count)
+{
+	CborEncodedMap map;
+	int32	   *pairs;
+	char	   *sorted;
+	Size		pos = 0;
+	int32		i;
+
+	if (count < 2)
+	{
+		for (i = 0; i < count * 2; ++i)
+			out = cbor_encode_item(out, value->entries, i, count * 2, true);
+		return out;
+	}
+
+	map.data = out;
+	map.start = cbor_core_alloc((2 * count + 1) * sizeof(Size));
+	map.keyend = map.start + count + 1;
+	pairs = cbor_core_alloc(2 * count * sizeof(int32));
+
+	for (i = 0; i < count; ++i)
+	{
+		map.start[i] = out - map.data;
+		out = cbor_encode_item(out, value->entries, i * 2, count * 2, true);
+		map.keyend[i] = out - map.data;
+		out = cbor_encode_item(out, value->entries, i * 2 + 1, count * 2, true);
+		pairs[i] = i;
+	}
+	map.start[count] = out - map.data;
+
+	cbor_merge_sort(pairs, pairs + count, count, cbor_encoded_key_cmp, &map);
+
+	sorted = cbor_core_alloc(map.start[count]);
+	for (i = 0; i < count; ++i)
+	{
+		Size		len = map.start[pairs[i] + 1] - map.start[pairs[i]];
+
+		memcpy(sorted + pos, map.data + map.start[pairs[i]], len);
+		pos += len;
+	}
+	memcpy(map.data, sorted, pos);
+
+	cbor_core_free(sorted);
+	cbor_core_free(pairs);
+	cbor_core_free(map.start);
+
+	return out;
+}
+
+static int
+cbor_encoded_key_cmp(int32 a, int32 b, void *arg)
+{
+	CborEncodedMap *map = arg;
+	Size		lenA = map->keyend[a] - map->start[a];
+	Size		lenB = map->keyend[b] - map->start[b];
+	int			res = memcmp(map->data + map->start[a], map->data + map->start[b], Min(lenA, lenB));
+
+	if (res)
+		return res;
+	if (lenA != lenB)
+		return lenA < lenB ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Reorder the pairs of a freshly written map by key and append the index of
+ * the original order.  The caller has to provide CBORCONTAINER_SORTSIZE
+ * bytes behind the values.  Returns the number of bytes appended.
+ */
+int32
+cbor_sort_map(CborContainer * container)
+{
+	int32		count = container->count;
+	int32		count2 = count * 2;
+	int32		datalen;
+	int32		pos;
+	int32		i;
+	int32	   *pairs;
+	CborEntry  *entries;
+	char	   *data;
+	char	   *target;
+	uint32	   *order;
+
+	if (CBORCONTAINER_SORTSIZE(count) == 0)
+		return 0;
+
+	pairs = cbor_core_alloc(count * 2 * sizeof(int32));
+	for (i = 0; i < count; ++i)
+		pairs[i] = i;
+	cbor_merge_sort(pairs, pairs + count, count, cbor_sort_map_cmp, container);
+
+	datalen = CBORENTRY_ENDPOS(container->entries, count2 - 1);
+	entries = cbor_core_alloc(count2 * sizeof(CborEntry) + datalen);
+	data = (char *) (entries + count2);
+	memcpy(entries, container->entries, count2 * sizeof(CborEntry) + datalen);
+
+	target = (char *) (container->entries + count2);
+	order = (uint32 *) (target + datalen);
+	pos = 0;
+
+	for (i = 0; i < count; ++i)
+	{
+		int32		j;
+
+		for (j = pairs[i] * 2; j <= pairs[i] * 2 + 1; ++j)
+		{
+			uint32		off = CBORENTRY_OFF(entries, j);
+			uint32		len = CBORENTRY_ENDPOS(entries, j) - off;
+
+			memcpy(target + pos, data + off, len);
+			pos += len;
+			container->entries[i * 2 + j - pairs[i] * 2] = (entries[j] & CBORENTRY_TYPEMASK) | pos;
+		}
+
+		order[pairs[i]] = i;
+	}
+
+	container->count = count | CBORCONTAINER_SORTED;
+
+	cbor_core_free(entries);
+	cbor_core_free(pairs);
+
+	return count * sizeof(uint32);
+}
+
+static int
+cbor_sort_map_cmp(int32 a, int32 b, void *arg)
+{
+	CborContainer *container = arg;
+
+	return cbor_cmp_entry(container->entries, a * 2, container->count * 2,
+						  container->entries, b * 2, container->count * 2);
+}
+
+/*
+ * Sort count items with cmp, using tmp as scratch space of the same size.
+ * The sort is stable, so equal items keep their order.
+ */
+static void
+cbor_merge_sort(int32 * items, int32 * tmp, int32 count, int (*cmp) (int32 a, int32 b, void *arg), void *arg)
+{
+	int32		half = count / 2;
+	int32		i = 0;
+	int32		j = half;
+	int32		k = 0;
+
+	if (count < 2)
+		return;
+
+	cbor_merge_sort(items, tmp, half, cmp, arg);
+	cbor_merge_sort(items + half, tmp, count - half, cmp, arg);
+
+	while (i < half && j < count)
+	{
+		if (cmp(items[j], items[i], arg) < 0)
+			tmp[k++] = items[j++];
+		else
+			tmp[k++] = items[i++];
+	}
+	while (i < half)
+		tmp[k++] = items[i++];
+	memcpy(items, tmp, k * sizeof(int32));
+}
+
+int
+cbor_cmp_entry(CborEntry * a, int32 nrA, int32 cntA, CborEntry * b, int32 nrB, int32 cntB)
+{
+	int32		i;
+	uint32		typeA = a[nrA] & CBORENTRY_TYPEMASK;
+	uint32		typeB = b[nrB] & CBORENTRY_TYPEMASK;
+
+	if (typeA < typeB)
+		return -1;
+	if (typeA > typeB)
+		return 1;
+
+	switch (typeA)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			{
+				uint64		valueA = cbor_get_scalar(a, nrA, cntA);
+				uint64		valueB = cbor_get_scalar(b, nrB, cntB);
+
+				if (valueA < valueB)
+					return -1;
+				if (valueA > valueB)
+					return 1;
+				break;
+			}
+
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			{
+				return lengthCompareCborText(CBORENTRY_VALUE(a, nrA, cntA), CBORENTRY_VALUE(b, nrB, cntB));
+			}
+
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				CborContainer *valueA = CBORENTRY_VALUE(a, nrA, cntA);
+				CborContainer *valueB = CBORENTRY_VALUE(b, nrB, cntB);
+
+				if (valueA->count < valueB->count)
+					return -1;
+				if (valueA->count > valueB->count)
+					return 1;
+				for (i = 0; i < valueA->count; ++i)
+				{
+					int			tmp = cbor_cmp_entry(valueA->entries, i, valueA->count, valueB->entries, i, valueB->count);
+
+					if (tmp)
+						return tmp;
+				}
+				break;
+			}
+
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *valueA = CBORENTRY_VALUE(a, nrA, cntA);
+				CborContainer *valueB = CBORENTRY_VALUE(b, nrB, cntB);
+				int32		count = CBORCONTAINER_COUNT(valueA);
+				uint32	   *orderA;
+				uint32	   *orderB;
+
+				if (count < CBORCONTAINER_COUNT(valueB))
+					return -1;
+				if (count > CBORCONTAINER_COUNT(valueB))
+					return 1;
+
+				orderA = CBORCONTAINER_IS_SORTED(valueA) ? CBORCONTAINER_ORDER(valueA) : NULL;
+				orderB = CBORCONTAINER_IS_SORTED(valueB) ? CBORCONTAINER_ORDER(valueB) : NULL;
+
+				for (i = 0; i < count * 2; ++i)
+				{
+					int32		entryA = (orderA ? orderA[i / 2] * 2 : i & ~1) + (i & 1);
+					int32		entryB = (orderB ? orderB[i / 2] * 2 : i & ~1) + (i & 1);
+					int			tmp = cbor_cmp_entry(valueA->entries, entryA, count * 2, valueB->entries, entryB, count * 2);
+
+					if (tmp)
+						return tmp;
+				}
+				break;
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *valueA = CBORENTRY_VALUE(a, nrA, cntA);
+				CborTag    *valueB = CBORENTRY_VALUE(b, nrB, cntB);
+
+				if (valueA->value < valueB->value)
+					return -1;
+				if (valueA->value > valueB->value)
+					return 1;
+				return cbor_cmp_entry(&valueA->entry, 0, 1, &valueB->entry, 0, 1);
+			}
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			{
+				uint64		valueA = cbor_get_scalar(a, nrA, cntA);
+				uint64		valueB = cbor_get_scalar(b, nrB, cntB);
+
+				if ((valueA & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				{
+					uint8		simpleA = valueA & 0xFF;
+					uint8		simpleB = valueB & 0xFF;
+
+					if ((valueB & CBOR_SIMPLEMASK) != CBOR_SIMPLE_VALUE)
+						return -1;
+					if (simpleA < simpleB)
+						return -1;
+					if (simpleA > simpleB)
+						return 1;
+				}
+				else
+				{
+					double		fltA = *((double *) &valueA);
+					double		fltB = *((double *) &valueB);
+
+					if ((valueB & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+						return 1;
+
+					/* NaN is equal to itself and above all other floats */
+					if (isnan(fltA))
+						return isnan(fltB) ? 0 : 1;
+					if (isnan(fltB))
+						return -1;
+					if (fltA < fltB)
+						return -1;
+					if (fltA > fltB)
+						return 1;
+				}
+				break;
+			}
+	}
+
+	return 0;
+}
+
+/*
+ * Values are hashed by a streaming 64 bit hash over their logical contents,
+ * so the result does not depend on the storage layout.  Every node mixes in
+ * its type together with its length or count, so nesting is reflected,
+ * followed by its scalar value or the bytes of its string, 8 at a time.
+ * The lower 32 bits of the hash with seed 0 are the standard hash.
+ */
+#define CBOR_HASH_PRIME1 UINT64CONST(0x9E3779B185EBCA87)
+#define CBOR_HASH_PRIME2 UINT64CONST(0xC2B2AE3D27D4EB4F)
+#define CBOR_HASH_PRIME3 UINT64CONST(0x165667B19E3779F9)
+
+static inline uint64
+cbor_hash_round(uint64 hash, uint64 value)
+{
+	hash += value * CBOR_HASH_PRIME2;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * CBOR_HASH_PRIME1;
+}
+
+uint64
+cbor_hash_entry_extended(CborEntry * entry, int32 nr, int32 cnt, uint64 seed)
+{
+	uint64		hash = cbor_hash_recursive(seed + CBOR_HASH_PRIME3, entry, nr, cnt);
+
+	hash ^= hash >> 33;
+	hash *= CBOR_HASH_PRIME2;
+	hash ^= hash >> 29;
+	hash *= CBOR_HASH_PRIME3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+uint32
+cbor_hash_entry(CborEntry * entry, int32 nr, int32 cnt)
+{
+	return (uint32) cbor_hash_entry_extended(entry, nr, cnt, 0);
+}
+
+static uint64
+cbor_hash_recursive(uint64 hash, CborEntry * entry, int32 nr, int32 cnt)
+{
+	int32		i;
+	uint64		type = (uint64) (entry[nr] & CBORENTRY_TYPEMASK) << 32;
+
+	cbor_core_check_depth();
+
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			{
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
+
+				/* -0.0 is equal to 0.0 */
+				if (value == UINT64CONST(0x8000000000000000) && type == (uint64) CBORENTRY_TYPE_FLOATORSIMPLE << 32)
+					value = 0;
+
+				hash = cbor_hash_round(hash, type);
+				hash = cbor_hash_round(hash, value);
+				break;
+			}
+
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			{
+				const char *str = CBORENTRY_GETSTR(entry, nr, cnt);
+				int32		len = CBORENTRY_STRLEN(entry, nr, cnt);
+				uint64		word;
+
+				hash = cbor_hash_round(hash, type | len);
+				for (; len >= sizeof(word); len -= sizeof(word), str += sizeof(word))
+				{
+					memcpy(&word, str, sizeof(word));
+					hash = cbor_hash_round(hash, word);
+				}
+				if (len > 0)
+				{
+					word = 0;
+					memcpy(&word, str, len);
+					hash = cbor_hash_round(hash, word);
+				}
+				break;
+			}
+
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				hash = cbor_hash_round(hash, type | value->count);
+				for (i = 0; i < value->count; ++i)
+					hash = cbor_hash_recursive(hash, value->entries, i, value->count);
+				break;
+			}
+
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count = CBORCONTAINER_COUNT(value);
+				uint32	   *order = CBORCONTAINER_IS_SORTED(value) ? CBORCONTAINER_ORDER(value) : NULL;
+
+				hash = cbor_hash_round(hash, type | count);
+				for (i = 0; i < count; ++i)
+				{
+					int32		pair = order ? order[i] : i;
+
+					hash = cbor_hash_recursive(hash, value->entries, pair * 2, count * 2);
+					hash = cbor_hash_recursive(hash, value->entries, pair * 2 + 1, count * 2);
+				}
+				break;
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				hash = cbor_hash_round(hash, type);
+				hash = cbor_hash_round(hash, value->value);
+				hash = cbor_hash_recursive(hash, &value->entry, 0, 1);
+				break;
+			}
+	}
+
+	return hash;
+}
+
+static int
+lengthCompareCborText(const void *a, const void *b)
+{
+	if (VARSIZE(a) == VARSIZE(b))
+		return memcmp(VARDATA(a), VARDATA(b), VARSIZE(a) - VARHDRSZ);
+	if (VARSIZE(a) < VARSIZE(b))
+		return -1;
+	return 1;
+}
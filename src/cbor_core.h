@@ -0,0 +1,259 @@
+#ifndef __CBOR_CORE_H__
+#define __CBOR_CORE_H__
+
+/*
+ * The layout of cbor values and the functions to decode, encode, compare
+ * and hash them.  They only depend on the backend for memory allocation
+ * and error reporting, which go through cbor_core_hooks.  Compiled with
+ * CBOR_CORE_STANDALONE they need nothing but the C library, so programs
+ * outside the backend can use the same code, see libcbor-core.a.
+ */
+#ifdef CBOR_CORE_STANDALONE
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t uint8;
+typedef int32_t int32;
+typedef uint32_t uint32;
+typedef int64_t int64;
+typedef uint64_t uint64;
+typedef size_t Size;
+
+#define UINT64CONST(x) UINT64_C(x)
+#define lengthof(array) (sizeof (array) / sizeof ((array)[0]))
+#define INTALIGN(LEN) (((uintptr_t) (LEN) + 3) & ~((uintptr_t) 3))
+#define Assert(condition) ((void) 0)
+#define Max(x, y) ((x) > (y) ? (x) : (y))
+#define Min(x, y) ((x) < (y) ? (x) : (y))
+
+/* the 4 byte varlena header as laid out by the backend */
+#define VARHDRSZ ((int32) sizeof(int32))
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define VARSIZE(PTR) (*(const uint32 *) (PTR) & 0x3FFFFFFF)
+#define SET_VARSIZE(PTR, len) (*(uint32 *) (PTR) = (uint32) (len) & 0x3FFFFFFF)
+#else
+#define VARSIZE(PTR) ((*(const uint32 *) (PTR) >> 2) & 0x3FFFFFFF)
+#define SET_VARSIZE(PTR, len) (*(uint32 *) (PTR) = (uint32) (len) << 2)
+#endif
+#define VARDATA(PTR) (((char *) (PTR)) + VARHDRSZ)
+#else
+#include "postgres.h"
+#endif
+
+#include <math.h>
+
+#ifdef __GNUC__
+#define CBOR_CORE_NORETURN __attribute__((noreturn))
+#define CBOR_CORE_PRINTF(f, a) __attribute__((format(printf, f, a)))
+#else
+#define CBOR_CORE_NORETURN
+#define CBOR_CORE_PRINTF(f, a)
+#endif
+
+typedef uint32 CborEntry;
+
+#define CBORENTRY_POSMASK 0x1FFFFFFF
+#define CBORENTRY_TYPEMASK 0xE0000000
+
+#define CBORENTRY_TYPE_UNSIGNEDINTEGER 0x00000000
+#define CBORENTRY_TYPE_NEGATIVEINTEGER 0x20000000
+#define CBORENTRY_TYPE_BYTESTRING 0x40000000
+#define CBORENTRY_TYPE_TEXTSTRING 0x60000000
+#define CBORENTRY_TYPE_ARRAY 0x80000000
+#define CBORENTRY_TYPE_MAP 0xA0000000
+#define CBORENTRY_TYPE_TAG 0xC0000000
+#define CBORENTRY_TYPE_FLOATORSIMPLE 0xE0000000
+
+#define CBORENTRY_ENDPOS(ce_, i) ((ce_)[i] & CBORENTRY_POSMASK)
+#define CBORENTRY_OFF(ce_, i) ((i) == 0 ? 0 : CBORENTRY_ENDPOS(ce_, i-1))
+#define CBORENTRY_VALUE(ce_, i, cnt) ((void*)((char*)((ce_) + cnt) + CBORENTRY_OFF(ce_, i)))
+
+#define CBORENTRY_GETSTR(ce_, i, cnt) (((char*) CBORENTRY_VALUE(ce_, i, cnt)) + VARHDRSZ)
+#define CBORENTRY_STRLEN(ce_, i, cnt) (VARSIZE(CBORENTRY_VALUE(ce_, i, cnt)) - VARHDRSZ)
+#define CBORENTRY_SETSTRLEN(ce_, i, cnt, len) SET_VARSIZE(CBORENTRY_VALUE(ce_, i, cnt), VARHDRSZ + len)
+
+#define CBOR_SIMPLE_VALUE 0x7FFFFFFFFFFFFF00
+#define CBOR_SIMPLEMASK   0xFFFFFFFFFFFFFF00
+
+/*
+ * Integers, floats and simple values take 4 bytes when they fit and 8 bytes
+ * otherwise, which is told apart by the width of the entry.  Floats of 4
+ * bytes use the single precision format and simple values of 4 bytes are
+ * stored as CBOR_SIMPLE_VALUE32 | value, which is a single precision NaN.
+ */
+#define CBOR_SIMPLE_VALUE32 0x7FFFFF00
+#define CBOR_SIMPLEMASK32   0xFFFFFF00
+
+#define CBORENTRY_WIDTH(ce_, i) (CBORENTRY_ENDPOS(ce_, i) - CBORENTRY_OFF(ce_, i))
+
+#define CBORENTRY_INDEFINITE 0x1F
+#define CBORENTRY_BREAK 0xFF
+
+typedef struct CborContainer
+{
+	int32		count;
+	CborEntry	entries[1];
+}	CborContainer;
+
+/*
+ * Maps with at least CBOR_SORTED_MAP_MIN pairs store their pairs sorted by
+ * key, so lookups can use a binary search.  The original order is kept in
+ * an uint32 array behind the values, which maps the position of a pair in
+ * the original order to its position in the entries.
+ */
+#define CBOR_SORTED_MAP_MIN 8
+
+#define CBORCONTAINER_SORTED 0x80000000
+#define CBORCONTAINER_COUNTMASK 0x7FFFFFFF
+
+#define CBORCONTAINER_COUNT(c) ((c)->count & CBORCONTAINER_COUNTMASK)
+#define CBORCONTAINER_IS_SORTED(c) (((c)->count & CBORCONTAINER_SORTED) != 0)
+#define CBORCONTAINER_ORDER(c) ((uint32 *) ((char *) ((c)->entries + CBORCONTAINER_COUNT(c) * 2) + CBORENTRY_ENDPOS((c)->entries, CBORCONTAINER_COUNT(c) * 2 - 1)))
+#define CBORCONTAINER_SORTSIZE(cnt) ((cnt) >= CBOR_SORTED_MAP_MIN ? (cnt) * sizeof(uint32) : 0)
+
+typedef struct CborTag
+{
+	uint64		value;
+	CborEntry	entry;
+}	CborTag;
+
+typedef struct Cbor
+{
+	/* varlena header (do not touch directly!) */
+	int32		vl_len_;
+	CborEntry	root;
+}	Cbor;
+
+
+/*
+ * Return the value of an integer, float or simple value entry as stored in
+ * 8 bytes.
+ */
+static inline uint64
+cbor_get_scalar(CborEntry * entry, int32 nr, int32 cnt)
+{
+	void	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+	uint32		value32;
+	float		flt;
+	double		dbl;
+	uint64		result;
+
+	if (CBORENTRY_WIDTH(entry, nr) != sizeof(uint32))
+		return *(uint64 *) value;
+
+	value32 = *(uint32 *) value;
+	if ((entry[nr] & CBORENTRY_TYPEMASK) != CBORENTRY_TYPE_FLOATORSIMPLE)
+		return value32;
+	if ((value32 & CBOR_SIMPLEMASK32) == CBOR_SIMPLE_VALUE32)
+		return CBOR_SIMPLE_VALUE | (value32 & 0xFF);
+
+	memcpy(&flt, &value32, sizeof(flt));
+	dbl = flt;
+	memcpy(&result, &dbl, sizeof(result));
+	return result;
+}
+
+/*
+ * Store an integer, float or simple value given as 8 bytes in its compact
+ * form and return the number of bytes used.  With data NULL only the size
+ * is computed.
+ */
+static inline Size
+cbor_put_scalar(char *data, CborEntry type, uint64 value)
+{
+	uint32		value32 = (uint32) value;
+	bool		compact;
+
+	if (type != CBORENTRY_TYPE_FLOATORSIMPLE)
+		compact = value <= 0xFFFFFFFF;
+	else if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+	{
+		value32 = CBOR_SIMPLE_VALUE32 | (value & 0xFF);
+		compact = true;
+	}
+	else
+	{
+		uint64		exponent = (value >> 52) & 0x7FF;
+
+		/* zero, infinity, NaN or a normal single without lost bits */
+		compact = !(value & 0x1FFFFFFF) && ((exponent == 0 && !(value & 0x000FFFFFFFFFFFFF)) || exponent == 0x7FF || (exponent >= 1023 - 126 && exponent <= 1023 + 127));
+		if (exponent == 0x7FF)
+			exponent = 0xFF;
+		else if (exponent)
+			exponent -= 1023 - 127;
+		value32 = (uint32) (value >> 32 & 0x80000000) | (uint32) (exponent << 23) | (uint32) (value >> 29 & 0x007FFFFF);
+		compact = compact && (value32 & CBOR_SIMPLEMASK32) != CBOR_SIMPLE_VALUE32;
+	}
+
+	if (!compact)
+	{
+		if (data)
+			*(uint64 *) data = value;
+		return sizeof(uint64);
+	}
+
+	if (data)
+		*(uint32 *) data = value32;
+	return sizeof(uint32);
+}
+
+#define CBOR_SIMPLE_FALSE 20
+#define CBOR_SIMPLE_TRUE 21
+#define CBOR_SIMPLE_NULL 22
+#define CBOR_SIMPLE_UNDEFINED 23
+
+/* the kinds of errors passed to the error hook */
+typedef enum
+{
+	CBOR_CORE_INVALID_INPUT,
+	CBOR_CORE_TOO_LARGE,
+	CBOR_CORE_OUT_OF_MEMORY
+}	CborCoreError;
+
+/*
+ * The memory allocation and error reporting of the core.  The error hook
+ * must not return.  check_depth is called before descending into nested
+ * values and may be NULL.  The defaults use palloc and ereport in the
+ * backend and malloc and abort() in standalone builds.
+ */
+typedef struct CborCoreHooks
+{
+	void	   *(*alloc) (Size size);
+	void	   *(*realloc) (void *ptr, Size size);
+	void		(*free) (void *ptr);
+	void		(*error) (CborCoreError code, const char *message);
+	void		(*check_depth) (void);
+}	CborCoreHooks;
+
+extern CborCoreHooks cbor_core_hooks;
+
+/*
+ * Counters of the work done by cbor_core_decode, which are only updated
+ * while cbor_core_stats is not NULL.
+ */
+typedef struct CborCoreStats
+{
+	uint64		items;			/* decoded data items */
+	int32		max_depth;		/* deepest nesting of decoded items */
+}	CborCoreStats;
+
+extern CborCoreStats *cbor_core_stats;
+
+extern void cbor_core_error(CborCoreError code, const char *fmt,...) CBOR_CORE_PRINTF(2, 3) CBOR_CORE_NORETURN;
+extern void cbor_check_size(Size size);
+
+extern Cbor *cbor_core_decode(const uint8 *data, Size len, Size *consumed);
+extern Size cbor_core_scan(const uint8 *data, Size len);
+extern bool cbor_core_complete(const uint8 *data, Size len);
+extern Size cbor_core_encoded_size(CborEntry * entry, int32 nr, int32 cnt);
+extern char *cbor_core_encode(char *out, CborEntry * entry, int32 nr, int32 cnt);
+extern char *cbor_core_encode_canonical(char *out, CborEntry * entry, int32 nr, int32 cnt);
+
+extern int	cbor_cmp_entry(CborEntry * a, int32 nrA, int32 cntA, CborEntry * b, int32 nrB, int32 cntB);
+extern int32 cbor_sort_map(CborContainer * container);
+extern uint32 cbor_hash_entry(CborEntry * entry, int32 nr, int32 cnt);
+extern uint64 cbor_hash_entry_extended(CborEntry * entry, int32 nr, int32 cnt, uint64 seed);
+
+#endif
@@ -0,0 +1,365 @@
+#include "cbor.h"
+
+#include "utils/memutils.h"
+
+static Size cbor_node_size(CborNode * node);
+static Size cbor_node_flatten(CborNode * node, char *data);
+static void cbor_node_init(CborNode * node, CborEntry * entry, int32 nr, int32 cnt);
+
+#if PG_VERSION_NUM >= 90500
+static Size cbor_get_flat_size(ExpandedObjectHeader *eohptr);
+static void cbor_flatten_into(ExpandedObjectHeader *eohptr, void *result, Size allocated_size);
+
+static const ExpandedObjectMethods cbor_expanded_methods =
+{
+	cbor_get_flat_size,
+	cbor_flatten_into
+};
+#endif
+
+
+/*
+ * Expand a cbor datum into a new ExpandedCbor below parentcontext.  The
+ * flat value is copied once and the tree initially consists of its root
+ * only, so expanding costs no more than a copy.
+ */
+ExpandedCbor *
+cbor_expand(Datum datum, MemoryContext parentcontext)
+{
+	MemoryContext objcxt;
+	MemoryContext oldcxt;
+	ExpandedCbor *ecb;
+	Cbor	   *flat;
+
+	objcxt = AllocSetContextCreate(parentcontext,
+								   "expanded cbor",
+								   ALLOCSET_SMALL_MINSIZE,
+								   ALLOCSET_SMALL_INITSIZE,
+								   ALLOCSET_DEFAULT_MAXSIZE);
+
+	ecb = MemoryContextAlloc(objcxt, sizeof(ExpandedCbor));
+#if PG_VERSION_NUM >= 90500
+	EOH_init_header(&ecb->hdr, &cbor_expanded_methods, objcxt);
+#endif
+	ecb->context = objcxt;
+
+	oldcxt = MemoryContextSwitchTo(objcxt);
+	flat = DatumGetCbor(PG_DETOAST_DATUM_COPY(datum));
+	MemoryContextSwitchTo(oldcxt);
+
+	cbor_node_init(&ecb->root, &flat->root, 0, 1);
+	ecb->root.owned = flat;
+	ecb->flat_size = VARSIZE(flat);
+
+	return ecb;
+}
+
+/*
+ * Return the ExpandedCbor of a datum for modification, which is the datum
+ * itself if it is a read-write expanded object and a new expansion in the
+ * current memory context otherwise.
+ */
+ExpandedCbor *
+DatumGetExpandedCbor(Datum datum)
+{
+#if PG_VERSION_NUM >= 90500
+	if (VARATT_IS_EXTERNAL_EXPANDED_RW(DatumGetPointer(datum)))
+	{
+		ExpandedCbor *ecb = (ExpandedCbor *) DatumGetEOHP(datum);
+
+		Assert(ecb->hdr.eoh_methods == &cbor_expanded_methods);
+		return ecb;
+	}
+#endif
+
+	return cbor_expand(datum, CurrentMemoryContext);
+}
+
+/*
+ * Return a modified ExpandedCbor as result datum, which is a read-write
+ * reference to it if expanded objects are supported and its flattened
+ * value otherwise.
+ */
+Datum
+ExpandedCborGetDatum(ExpandedCbor * ecb)
+{
+#if PG_VERSION_NUM >= 90500
+	return EOHPGetRWDatum(&ecb->hdr);
+#else
+	Size		size = offsetof(Cbor, root) + sizeof(CborEntry) + cbor_node_size(&ecb->root);
+	Cbor	   *result;
+
+	cbor_check_size(size);
+	result = palloc0(size);
+	SET_VARSIZE(result, size);
+	result->root = ecb->root.type | cbor_node_flatten(&ecb->root, (char *) (&result->root + 1));
+
+	MemoryContextDelete(ecb->context);
+	return PointerGetDatum(result);
+#endif
+}
+
+/*
+ * Expand an array or map into its items, which refer to the flat values of
+ * the container.  Items of sorted maps are put back into their original
+ * order, which is restored by the sort when flattening.  Maps written
+ * before they were sorted get sorted as well, so the flat size changes even
+ * if the items do not.
+ */
+void
+cbor_node_expand(ExpandedCbor * ecb, CborNode * node)
+{
+	CborContainer *container;
+	uint32	   *order = NULL;
+	int32		count;
+	int32		cnt;
+	int32		i;
+
+	if (node->entry == NULL || (node->type != CBORENTRY_TYPE_ARRAY && node->type != CBORENTRY_TYPE_MAP))
+		return;
+
+	container = CBORENTRY_VALUE(node->entry, node->nr, node->cnt);
+	count = CBORCONTAINER_COUNT(container);
+	cnt = node->type == CBORENTRY_TYPE_MAP ? count * 2 : count;
+	if (CBORCONTAINER_IS_SORTED(container))
+		order = CBORCONTAINER_ORDER(container);
+
+	node->entry = NULL;
+	node->count = cnt;
+	ecb->flat_size = 0;
+	node->allocated = Max(cnt, 4);
+	node->items = MemoryContextAlloc(ecb->context, node->allocated * sizeof(CborNode));
+
+	if (node->type == CBORENTRY_TYPE_MAP)
+	{
+		for (i = 0; i < count; ++i)
+		{
+			int32		pos = order ? order[i] : i;
+
+			cbor_node_init(&node->items[i * 2], container->entries, pos * 2, cnt);
+			cbor_node_init(&node->items[i * 2 + 1], container->entries, pos * 2 + 1, cnt);
+		}
+	}
+	else
+	{
+		for (i = 0; i < count; ++i)
+			cbor_node_init(&node->items[i], container->entries, i, cnt);
+	}
+}
+
+/*
+ * Replace the value of a node by a copy of value, freeing what the node
+ * held before, so setting the same path repeatedly does not accumulate
+ * memory.  The node has to be initialized, if only to zeros.
+ */
+void
+cbor_node_set(ExpandedCbor * ecb, CborNode * node, Cbor * value)
+{
+	Cbor	   *copy = MemoryContextAlloc(ecb->context, VARSIZE(value));
+
+	memcpy(copy, value, VARSIZE(value));
+	cbor_node_free(node);
+	cbor_node_init(node, &copy->root, 0, 1);
+	node->owned = copy;
+	ecb->flat_size = 0;
+}
+
+/*
+ * Free the items and the owned copy of a node and everything below it.
+ * The node itself is left dangling and has to be set or removed.
+ */
+void
+cbor_node_free(CborNode * node)
+{
+	int32		i;
+
+	if (node->items)
+	{
+		for (i = 0; i < node->count; ++i)
+			cbor_node_free(&node->items[i]);
+		pfree(node->items);
+		node->items = NULL;
+	}
+
+	if (node->owned)
+	{
+		pfree(node->owned);
+		node->owned = NULL;
+	}
+}
+
+/*
+ * Make room for n items at position pos of an expanded container and return
+ * the first of them, which the caller has to set.  The new items are zeroed
+ * and pointers to the items of the container are invalidated.
+ */
+CborNode *
+cbor_node_insert(ExpandedCbor * ecb, CborNode * node, int32 pos, int32 n)
+{
+	Assert(node->entry == NULL && pos >= 0 && pos <= node->count);
+
+	if (node->count + n > node->allocated)
+	{
+		node->allocated = Max(node->allocated * 2, node->count + n);
+		if (node->items)
+			node->items = repalloc(node->items, node->allocated * sizeof(CborNode));
+		else
+			node->items = MemoryContextAlloc(ecb->context, node->allocated * sizeof(CborNode));
+	}
+
+	memmove(&node->items[pos + n], &node->items[pos], (node->count - pos) * sizeof(CborNode));
+	memset(&node->items[pos], 0, n * sizeof(CborNode));
+	node->count += n;
+	ecb->flat_size = 0;
+
+	return &node->items[pos];
+}
+
+/*
+ * Remove n items at position pos of an expanded container and free them.
+ */
+void
+cbor_node_remove(ExpandedCbor * ecb, CborNode * node, int32 pos, int32 n)
+{
+	int32		i;
+
+	Assert(node->entry == NULL && pos >= 0 && pos + n <= node->count);
+
+	for (i = pos; i < pos + n; ++i)
+		cbor_node_free(&node->items[i]);
+
+	memmove(&node->items[pos], &node->items[pos + n], (node->count - pos - n) * sizeof(CborNode));
+	node->count -= n;
+	ecb->flat_size = 0;
+}
+
+/*
+ * Expand a map and return the position of the value belonging to the
+ * first text string key equal to key, or -1 if there is none.
+ */
+int32
+cbor_node_find_key(ExpandedCbor * ecb, CborNode * node, const char *key, int32 keylen)
+{
+	int32		i;
+
+	if (node->type != CBORENTRY_TYPE_MAP)
+		return -1;
+
+	cbor_node_expand(ecb, node);
+
+	for (i = 0; i < node->count; i += 2)
+	{
+		CborNode   *item = &node->items[i];
+
+		if (item->type == CBORENTRY_TYPE_TEXTSTRING &&
+			CBORENTRY_STRLEN(item->entry, item->nr, item->cnt) == keylen &&
+			memcmp(CBORENTRY_GETSTR(item->entry, item->nr, item->cnt), key, keylen) == 0)
+			return i + 1;
+	}
+
+	return -1;
+}
+
+
+static void
+cbor_node_init(CborNode * node, CborEntry * entry, int32 nr, int32 cnt)
+{
+	node->type = entry[nr] & CBORENTRY_TYPEMASK;
+	node->entry = entry;
+	node->nr = nr;
+	node->cnt = cnt;
+	node->count = 0;
+	node->allocated = 0;
+	node->items = NULL;
+	node->owned = NULL;
+}
+
+/*
+ * Return the number of bytes the value of a node takes when flattened.
+ */
+static Size
+cbor_node_size(CborNode * node)
+{
+	Size		size;
+	int32		i;
+
+	if (node->entry)
+		return CBORENTRY_WIDTH(node->entry, node->nr);
+
+	size = offsetof(CborContainer, entries) + node->count * sizeof(CborEntry);
+	for (i = 0; i < node->count; ++i)
+		size += cbor_node_size(&node->items[i]);
+
+	if (node->type == CBORENTRY_TYPE_MAP)
+		size += CBORCONTAINER_SORTSIZE(node->count / 2);
+
+	return size;
+}
+
+/*
+ * Write the value of a node to data and return the number of bytes written.
+ * Values not expanded are copied as they are.
+ */
+static Size
+cbor_node_flatten(CborNode * node, char *data)
+{
+	CborContainer *container;
+	char	   *values;
+	Size		pos = 0;
+	int32		i;
+
+	if (node->entry)
+	{
+		Size		len = CBORENTRY_WIDTH(node->entry, node->nr);
+
+		memcpy(data, CBORENTRY_VALUE(node->entry, node->nr, node->cnt), len);
+		return len;
+	}
+
+	container = (CborContainer *) data;
+	container->count = node->type == CBORENTRY_TYPE_MAP ? node->count / 2 : node->count;
+	values = (char *) (container->entries + node->count);
+
+	for (i = 0; i < node->count; ++i)
+	{
+		pos += cbor_node_flatten(&node->items[i], values + pos);
+		container->entries[i] = node->items[i].type | pos;
+	}
+
+	if (node->type == CBORENTRY_TYPE_MAP)
+		pos += cbor_sort_map(container);
+
+	return values + pos - data;
+}
+
+#if PG_VERSION_NUM >= 90500
+static Size
+cbor_get_flat_size(ExpandedObjectHeader *eohptr)
+{
+	ExpandedCbor *ecb = (ExpandedCbor *) eohptr;
+	Size		size;
+
+	if (ecb->flat_size)
+		return ecb->flat_size;
+
+	size = cbor_node_size(&ecb->root);
+	cbor_check_size(size);
+
+	ecb->flat_size = offsetof(Cbor, root) + sizeof(CborEntry) + size;
+	return ecb->flat_size;
+}
+
+static void
+cbor_flatten_into(ExpandedObjectHeader *eohptr, void *result, Size allocated_size)
+{
+	ExpandedCbor *ecb = (ExpandedCbor *) eohptr;
+	Cbor	   *cbor = (Cbor *) result;
+
+	if (allocated_size != offsetof(Cbor, root) + sizeof(CborEntry) + cbor_node_size(&ecb->root))
+		elog(ERROR, "cbor_flatten_into called with wrong size %lu", (unsigned long) allocated_size);
+
+	memset(cbor, 0, allocated_size);
+	SET_VARSIZE(cbor, allocated_size);
+	cbor->root = ecb->root.type | cbor_node_flatten(&ecb->root, (char *) (&cbor->root + 1));
+}
+#endif
@@ -0,0 +1,1314 @@
+#include "cbor.h"
+#include <math.h>
+
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+#include "utils/numeric.h"
+#include "utils/timestamp.h"
+
+/*
+ * The set returning functions keep the detoasted value for all calls and
+ * copy out a single element or pair per call, so the memory they use does
+ * not grow with the number of elements.
+ */
+typedef struct CborIterator
+{
+	CborContainer *container;
+	int32		count;			/* number of entries */
+	uint32	   *order;			/* original order of a sorted map, or NULL */
+	TupleDesc	tupdesc;
+}	CborIterator;
+
+/*
+ * The aggregates build their result in a CborBuilder, which holds the
+ * entries and values of the elements in the layout of a container, so the
+ * final function only copies them behind the container header.  Maps hold
+ * alternating keys and values and are sorted by the final function.
+ */
+typedef struct CborBuilder
+{
+	CborEntry  *entries;
+	int32		count;
+	int32		allocated;
+	StringInfoData values;
+}	CborBuilder;
+
+/*
+ * How SQL values of a type are converted into cbor, cached in fn_extra.
+ */
+typedef struct CborConverter
+{
+	Oid			typid;			/* base type */
+	bool		is_cbor;
+	bool		is_cbor_raw;
+	FmgrInfo	outfunc;
+}	CborConverter;
+
+static FuncCallContext *cbor_iterator_setup(FunctionCallInfo fcinfo, CborEntry type, const char *funcname, bool tuples);
+static int32 cbor_iterator_pair(CborIterator * it, int32 i);
+static CborBuilder *cbor_builder_create(MemoryContext context);
+static void cbor_builder_add(CborBuilder * builder, CborEntry type, const char *value, Size len);
+static Cbor *cbor_builder_finish(CborBuilder * builder, CborEntry type);
+static void cbor_builder_add_datum(FunctionCallInfo fcinfo, CborBuilder * builder, int argno);
+static Cbor *cbor_make_scalar(CborEntry type, uint64 value);
+static Cbor *cbor_make_string(CborEntry type, const char *str, Size len);
+static Cbor *cbor_make_int(int64 value);
+static Cbor *cbor_make_float(double value);
+static int32 *cbor_node_sorted_pairs(CborNode * node);
+static bool cbor_node_unique_keys(CborNode * node);
+static int32 cbor_node_search_key(CborNode * node, int32 *sorted, int32 npairs, CborNode * key);
+static int32 cbor_node_scan_key(CborNode * node, int32 from, int32 to, CborNode * key);
+static int32 cbor_node_step(ExpandedCbor * ecb, CborNode * node, Datum *elems, bool *nulls, int32 i, int32 *index);
+static void cbor_node_wrap(ExpandedCbor * ecb, CborNode * node);
+static void cbor_node_copy(ExpandedCbor * ecb, CborNode * node, CborNode * item);
+static bool cbor_node_key_equals(CborNode * key, CborEntry type, const char *str, int32 len, uint64 uint);
+static Datum cbor_delete_key(Datum datum, CborEntry type, const char *str, int32 len, uint64 uint);
+static bool cbor_entry_is_null(CborEntry * entry, int32 nr, int32 cnt);
+static void cbor_cannot_cast(CborEntry * entry, int32 nr, int32 cnt, const char *prefix, Oid typid);
+static TimestampTz cbor_epoch_to_timestamptz(CborEntry * entry, int32 nr, int32 cnt);
+
+
+PG_FUNCTION_INFO_V1(cbor_array_elements);
+Datum
+cbor_array_elements(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx = cbor_iterator_setup(fcinfo, CBORENTRY_TYPE_ARRAY, "cbor_array_elements", false);
+	CborIterator *it = funcctx->user_fctx;
+	int32		i = funcctx->call_cntr;
+
+	if (i >= it->count)
+		SRF_RETURN_DONE(funcctx);
+
+	SRF_RETURN_NEXT(funcctx, PointerGetDatum(cbor_from_entry(it->container->entries, i, it->count)));
+}
+
+PG_FUNCTION_INFO_V1(cbor_each);
+Datum
+cbor_each(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx = cbor_iterator_setup(fcinfo, CBORENTRY_TYPE_MAP, "cbor_each", true);
+	CborIterator *it = funcctx->user_fctx;
+	int32		pair;
+	text	   *key;
+	Datum		values[2];
+	bool		nulls[2] = {false, false};
+
+	if (funcctx->call_cntr >= it->count / 2)
+		SRF_RETURN_DONE(funcctx);
+
+	pair = cbor_iterator_pair(it, funcctx->call_cntr);
+	key = cbor_entry_to_text(it->container->entries, pair, it->count);
+
+	values[0] = PointerGetDatum(key);
+	nulls[0] = (key == NULL);
+	values[1] = PointerGetDatum(cbor_from_entry(it->container->entries, pair + 1, it->count));
+
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(it->tupdesc, values, nulls)));
+}
+
+PG_FUNCTION_INFO_V1(cbor_object_keys);
+Datum
+cbor_object_keys(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx = cbor_iterator_setup(fcinfo, CBORENTRY_TYPE_MAP, "cbor_object_keys", false);
+	CborIterator *it = funcctx->user_fctx;
+	text	   *key;
+
+	if (funcctx->call_cntr >= it->count / 2)
+		SRF_RETURN_DONE(funcctx);
+
+	key = cbor_entry_to_text(it->container->entries, cbor_iterator_pair(it, funcctx->call_cntr), it->count);
+	if (!key)
+	{
+		/* a null key, like SRF_RETURN_NEXT_NULL of newer releases */
+		funcctx->call_cntr++;
+		((ReturnSetInfo *) fcinfo->resultinfo)->isDone = ExprMultipleResult;
+		PG_RETURN_NULL();
+	}
+
+	SRF_RETURN_NEXT(funcctx, PointerGetDatum(key));
+}
+
+
+static FuncCallContext *
+cbor_iterator_setup(FunctionCallInfo fcinfo, CborEntry type, const char *funcname, bool tuples)
+{
+	if (SRF_IS_FIRSTCALL())
+	{
+		FuncCallContext *funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		Cbor	   *cbor = PG_GETARG_CBOR(0);
+		CborIterator *it;
+
+		if ((cbor->root & CBORENTRY_TYPEMASK) != type)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("cannot call %s on a cbor value that is not %s",
+							funcname, type == CBORENTRY_TYPE_ARRAY ? "an array" : "a map")));
+
+		it = palloc0(sizeof(CborIterator));
+		it->container = CBORENTRY_VALUE(&cbor->root, 0, 1);
+		it->count = CBORCONTAINER_COUNT(it->container);
+		if (type == CBORENTRY_TYPE_MAP)
+		{
+			if (CBORCONTAINER_IS_SORTED(it->container))
+				it->order = CBORCONTAINER_ORDER(it->container);
+			it->count *= 2;
+		}
+
+		if (tuples)
+		{
+			TupleDesc	tupdesc;
+
+			if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("function returning record called in context that cannot accept type record")));
+			it->tupdesc = BlessTupleDesc(tupdesc);
+		}
+
+		funcctx->user_fctx = it;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	return SRF_PERCALL_SETUP();
+}
+
+/*
+ * Return the entry number of the key of the pair at position i in the
+ * original order of the map.
+ */
+static int32
+cbor_iterator_pair(CborIterator * it, int32 i)
+{
+	return (it->order ? it->order[i] : i) * 2;
+}
+
+
+/*
+ * Replace the value at path by value.  With create_missing a missing map
+ * key in the last path element is added and an array index out of range
+ * prepends or appends the value.  Otherwise the value is returned
+ * unchanged if the path does not exist.
+ */
+PG_FUNCTION_INFO_V1(cbor_set);
+Datum
+cbor_set(PG_FUNCTION_ARGS)
+{
+	ExpandedCbor *ecb = DatumGetExpandedCbor(PG_GETARG_DATUM(0));
+	ArrayType  *path = PG_GETARG_ARRAYTYPE_P(1);
+	Cbor	   *value = PG_GETARG_CBOR(2);
+	bool		create_missing = PG_GETARG_BOOL(3);
+	CborNode   *node = &ecb->root;
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nelems;
+	int			i;
+
+	if (ARR_NDIM(path) > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("wrong number of array subscripts")));
+
+	deconstruct_array(path, TEXTOID, -1, false, 'i', &elems, &nulls, &nelems);
+
+	for (i = 0; i < nelems; ++i)
+	{
+		int32		index;
+		int32		pos = cbor_node_step(ecb, node, elems, nulls, i, &index);
+
+		if (pos < 0)
+		{
+			if (!create_missing || i != nelems - 1)
+				break;
+
+			if (node->type == CBORENTRY_TYPE_MAP)
+			{
+				text	   *key = DatumGetTextPP(elems[i]);
+				CborNode   *items = cbor_node_insert(ecb, node, node->count, 2);
+
+				cbor_node_set(ecb, &items[0], cbor_make_string(CBORENTRY_TYPE_TEXTSTRING, VARDATA_ANY(key), VARSIZE_ANY_EXHDR(key)));
+				cbor_node_set(ecb, &items[1], value);
+			}
+			else if (node->type == CBORENTRY_TYPE_ARRAY)
+				cbor_node_set(ecb, cbor_node_insert(ecb, node, index < 0 ? 0 : node->count, 1), value);
+			break;
+		}
+
+		node = &node->items[pos];
+		if (i == nelems - 1)
+			cbor_node_set(ecb, node, value);
+	}
+
+	PG_RETURN_DATUM(ExpandedCborGetDatum(ecb));
+}
+
+/*
+ * Remove the value at path, together with its key in maps.
+ */
+PG_FUNCTION_INFO_V1(cbor_delete_path);
+Datum
+cbor_delete_path(PG_FUNCTION_ARGS)
+{
+	ExpandedCbor *ecb = DatumGetExpandedCbor(PG_GETARG_DATUM(0));
+	ArrayType  *path = PG_GETARG_ARRAYTYPE_P(1);
+	CborNode   *node = &ecb->root;
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nelems;
+	int			i;
+
+	if (ARR_NDIM(path) > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("wrong number of array subscripts")));
+
+	deconstruct_array(path, TEXTOID, -1, false, 'i', &elems, &nulls, &nelems);
+
+	for (i = 0; i < nelems; ++i)
+	{
+		int32		index;
+		int32		pos = cbor_node_step(ecb, node, elems, nulls, i, &index);
+
+		if (pos < 0)
+			break;
+
+		if (i == nelems - 1)
+		{
+			if (node->type == CBORENTRY_TYPE_MAP)
+				cbor_node_remove(ecb, node, pos - 1, 2);
+			else
+				cbor_node_remove(ecb, node, pos, 1);
+		}
+		else
+			node = &node->items[pos];
+	}
+
+	PG_RETURN_DATUM(ExpandedCborGetDatum(ecb));
+}
+
+/*
+ * Remove all pairs with the text string key from a map or all text string
+ * elements equal to it from an array.
+ */
+PG_FUNCTION_INFO_V1(cbor_delete);
+Datum
+cbor_delete(PG_FUNCTION_ARGS)
+{
+	text	   *key = PG_GETARG_TEXT_PP(1);
+
+	PG_RETURN_DATUM(cbor_delete_key(PG_GETARG_DATUM(0), CBORENTRY_TYPE_TEXTSTRING, VARDATA_ANY(key), VARSIZE_ANY_EXHDR(key), 0));
+}
+
+/*
+ * Remove the array element at index, counting from the end for negative
+ * indexes, or all pairs with the integer key from a map.
+ */
+PG_FUNCTION_INFO_V1(cbor_delete_idx);
+Datum
+cbor_delete_idx(PG_FUNCTION_ARGS)
+{
+	int32		index = PG_GETARG_INT32(1);
+
+	if (index < 0)
+		PG_RETURN_DATUM(cbor_delete_key(PG_GETARG_DATUM(0), CBORENTRY_TYPE_NEGATIVEINTEGER, NULL, 0, (uint64) (-1 - (int64) index)));
+	PG_RETURN_DATUM(cbor_delete_key(PG_GETARG_DATUM(0), CBORENTRY_TYPE_UNSIGNEDINTEGER, NULL, 0, (uint64) index));
+}
+
+/*
+ * Concatenate two arrays or merge two maps, with the pairs of the second
+ * map replacing those of the first one with equal keys.  Other values are
+ * treated as arrays of a single element.  The items taken from the second
+ * value are copied into nodes of their own, so its expansion can be freed.
+ */
+PG_FUNCTION_INFO_V1(cbor_concat);
+Datum
+cbor_concat(PG_FUNCTION_ARGS)
+{
+	ExpandedCbor *ecb = DatumGetExpandedCbor(PG_GETARG_DATUM(0));
+	CborNode   *root = &ecb->root;
+	CborNode	other;
+	CborNode   *items;
+	int32		i;
+	int32		j;
+
+	memset(&other, 0, sizeof(other));
+	cbor_node_set(ecb, &other, PG_GETARG_CBOR(1));
+
+	if (root->type == CBORENTRY_TYPE_MAP && other.type == CBORENTRY_TYPE_MAP)
+	{
+		int32	   *sorted = cbor_node_sorted_pairs(root);
+		bool		unique = cbor_node_unique_keys(&other);
+		int32		count;
+
+		cbor_node_expand(ecb, root);
+		cbor_node_expand(ecb, &other);
+		count = root->count;
+
+		for (i = 0; i < other.count; i += 2)
+		{
+			CborNode   *key = &other.items[i];
+
+			/*
+			 * Keys of the first map are looked up by binary search if it is
+			 * sorted.  Appended pairs only need to be searched if the second
+			 * map repeats a key.
+			 */
+			if (sorted)
+				j = cbor_node_search_key(root, sorted, count / 2, key);
+			else
+				j = cbor_node_scan_key(root, 0, count, key);
+			if (j < 0 && !unique)
+				j = cbor_node_scan_key(root, count, root->count, key);
+
+			if (j >= 0)
+				cbor_node_copy(ecb, &root->items[j + 1], &other.items[i + 1]);
+			else
+			{
+				items = cbor_node_insert(ecb, root, root->count, 2);
+				cbor_node_copy(ecb, &items[0], key);
+				cbor_node_copy(ecb, &items[1], &other.items[i + 1]);
+			}
+		}
+
+		if (sorted)
+			pfree(sorted);
+	}
+	else
+	{
+		cbor_node_wrap(ecb, root);
+		cbor_node_wrap(ecb, &other);
+		items = cbor_node_insert(ecb, root, root->count, other.count);
+		for (i = 0; i < other.count; ++i)
+			cbor_node_copy(ecb, &items[i], &other.items[i]);
+	}
+
+	cbor_node_free(&other);
+
+	PG_RETURN_DATUM(ExpandedCborGetDatum(ecb));
+}
+
+/*
+ * Return the pairs of a flat sorted map in the order of their keys, as
+ * indexes of the pairs once the node is expanded, or NULL if the node is
+ * not a flat sorted map.
+ */
+static int32 *
+cbor_node_sorted_pairs(CborNode * node)
+{
+	CborContainer *container;
+	uint32	   *order;
+	int32	   *sorted;
+	int32		count;
+	int32		i;
+
+	if (node->entry == NULL)
+		return NULL;
+
+	container = CBORENTRY_VALUE(node->entry, node->nr, node->cnt);
+	if (!CBORCONTAINER_IS_SORTED(container))
+		return NULL;
+
+	count = CBORCONTAINER_COUNT(container);
+	order = CBORCONTAINER_ORDER(container);
+	sorted = palloc(count * sizeof(int32));
+	for (i = 0; i < count; ++i)
+		sorted[order[i]] = i;
+
+	return sorted;
+}
+
+/*
+ * Return whether the keys of a map are known to be distinct, which is only
+ * checked for flat sorted maps, where equal keys are adjacent.
+ */
+static bool
+cbor_node_unique_keys(CborNode * node)
+{
+	CborContainer *container;
+	int32		count;
+	int32		i;
+
+	if (node->entry == NULL)
+		return false;
+
+	container = CBORENTRY_VALUE(node->entry, node->nr, node->cnt);
+	if (!CBORCONTAINER_IS_SORTED(container))
+		return false;
+
+	count = CBORCONTAINER_COUNT(container) * 2;
+	for (i = 2; i < count; i += 2)
+	{
+		if (cbor_cmp_entry(container->entries, i - 2, count, container->entries, i, count) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Return the index of the first key of an expanded map equal to key, or -1.
+ * sorted holds the first npairs pairs of the map in the order of their keys,
+ * and pairs with equal keys in their original order.
+ */
+static int32
+cbor_node_search_key(CborNode * node, int32 *sorted, int32 npairs, CborNode * key)
+{
+	int32		low = 0;
+	int32		high = npairs;
+
+	while (low < high)
+	{
+		int32		mid = low + (high - low) / 2;
+		CborNode   *item = &node->items[sorted[mid] * 2];
+
+		if (cbor_cmp_entry(item->entry, item->nr, item->cnt, key->entry, key->nr, key->cnt) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < npairs)
+	{
+		CborNode   *item = &node->items[sorted[low] * 2];
+
+		if (cbor_cmp_entry(item->entry, item->nr, item->cnt, key->entry, key->nr, key->cnt) == 0)
+			return sorted[low] * 2;
+	}
+
+	return -1;
+}
+
+/*
+ * Return the index of the first key equal to key among the items from and
+ * up to to of an expanded map, or -1.
+ */
+static int32
+cbor_node_scan_key(CborNode * node, int32 from, int32 to, CborNode * key)
+{
+	int32		j;
+
+	for (j = from; j < to; j += 2)
+	{
+		if (cbor_cmp_entry(node->items[j].entry, node->items[j].nr, node->items[j].cnt, key->entry, key->nr, key->cnt) == 0)
+			return j;
+	}
+
+	return -1;
+}
+
+/*
+ * The typed extraction functions read the scalar or string at the root
+ * directly instead of going through its text representation.  Null and
+ * undefined yield SQL NULL and values of other types are rejected.
+ */
+PG_FUNCTION_INFO_V1(cbor_to_int8);
+Datum
+cbor_to_int8(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	uint64		value;
+	double		dbl;
+
+	if (cbor_entry_is_null(&cbor->root, 0, 1))
+		PG_RETURN_NULL();
+
+	switch (cbor->root & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			value = cbor_get_scalar(&cbor->root, 0, 1);
+			if (value > PG_INT64_MAX)
+				break;
+			if ((cbor->root & CBORENTRY_TYPEMASK) == CBORENTRY_TYPE_NEGATIVEINTEGER)
+				PG_RETURN_INT64(-1 - (int64) value);
+			PG_RETURN_INT64((int64) value);
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			value = cbor_get_scalar(&cbor->root, 0, 1);
+			if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				cbor_cannot_cast(&cbor->root, 0, 1, "", INT8OID);
+
+			/* round like the cast from double precision */
+			memcpy(&dbl, &value, sizeof(dbl));
+			dbl = rint(dbl);
+			if (isnan(dbl) || dbl < (double) PG_INT64_MIN || dbl >= -(double) PG_INT64_MIN)
+				break;
+			PG_RETURN_INT64((int64) dbl);
+
+		default:
+			cbor_cannot_cast(&cbor->root, 0, 1, "", INT8OID);
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+			 errmsg("bigint out of range")));
+	PG_RETURN_NULL();
+}
+
+PG_FUNCTION_INFO_V1(cbor_to_float8);
+Datum
+cbor_to_float8(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	uint64		value;
+	double		dbl;
+
+	if (cbor_entry_is_null(&cbor->root, 0, 1))
+		PG_RETURN_NULL();
+
+	switch (cbor->root & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+			PG_RETURN_FLOAT8((double) cbor_get_scalar(&cbor->root, 0, 1));
+
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			PG_RETURN_FLOAT8(-1.0 - (double) cbor_get_scalar(&cbor->root, 0, 1));
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			value = cbor_get_scalar(&cbor->root, 0, 1);
+			if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				break;
+			memcpy(&dbl, &value, sizeof(dbl));
+			PG_RETURN_FLOAT8(dbl);
+	}
+
+	cbor_cannot_cast(&cbor->root, 0, 1, "", FLOAT8OID);
+	PG_RETURN_NULL();
+}
+
+/*
+ * Byte strings are stored as varlenas, so the result is a plain copy.
+ */
+PG_FUNCTION_INFO_V1(cbor_to_bytea);
+Datum
+cbor_to_bytea(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	bytea	   *value;
+	bytea	   *result;
+
+	if (cbor_entry_is_null(&cbor->root, 0, 1))
+		PG_RETURN_NULL();
+	if ((cbor->root & CBORENTRY_TYPEMASK) != CBORENTRY_TYPE_BYTESTRING)
+		cbor_cannot_cast(&cbor->root, 0, 1, "", BYTEAOID);
+
+	value = CBORENTRY_VALUE(&cbor->root, 0, 1);
+	result = palloc(VARSIZE(value));
+	memcpy(result, value, VARSIZE(value));
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+/*
+ * Tag 0 encloses a date and time string as of RFC 3339 and tag 1 the
+ * seconds since the Unix epoch as integer or float.
+ */
+PG_FUNCTION_INFO_V1(cbor_to_timestamptz);
+Datum
+cbor_to_timestamptz(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	CborTag    *tag;
+	char		prefix[32];
+
+	if (cbor_entry_is_null(&cbor->root, 0, 1))
+		PG_RETURN_NULL();
+	if ((cbor->root & CBORENTRY_TYPEMASK) != CBORENTRY_TYPE_TAG)
+		cbor_cannot_cast(&cbor->root, 0, 1, "", TIMESTAMPTZOID);
+
+	tag = CBORENTRY_VALUE(&cbor->root, 0, 1);
+	snprintf(prefix, sizeof(prefix), "tag " UINT64_FORMAT " of ", tag->value);
+
+	switch (tag->value)
+	{
+		case 0:
+			if ((tag->entry & CBORENTRY_TYPEMASK) != CBORENTRY_TYPE_TEXTSTRING)
+				break;
+			PG_RETURN_DATUM(DirectFunctionCall3(timestamptz_in,
+												CStringGetDatum(pnstrdup(CBORENTRY_GETSTR(&tag->entry, 0, 1), CBORENTRY_STRLEN(&tag->entry, 0, 1))),
+												ObjectIdGetDatum(InvalidOid),
+												Int32GetDatum(-1)));
+
+		case 1:
+			PG_RETURN_TIMESTAMPTZ(cbor_epoch_to_timestamptz(&tag->entry, 0, 1));
+
+		default:
+			cbor_cannot_cast(&cbor->root, 0, 1, "", TIMESTAMPTZOID);
+	}
+
+	cbor_cannot_cast(&tag->entry, 0, 1, prefix, TIMESTAMPTZOID);
+	PG_RETURN_NULL();
+}
+
+PG_FUNCTION_INFO_V1(cbor_agg_transfn);
+Datum
+cbor_agg_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	CborBuilder *builder;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "cbor_agg_transfn called in non-aggregate context");
+
+	builder = PG_ARGISNULL(0) ? cbor_builder_create(aggcontext) : (CborBuilder *) PG_GETARG_POINTER(0);
+	cbor_builder_add_datum(fcinfo, builder, 1);
+
+	PG_RETURN_POINTER(builder);
+}
+
+PG_FUNCTION_INFO_V1(cbor_agg_finalfn);
+Datum
+cbor_agg_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_CBOR(cbor_builder_finish((CborBuilder *) PG_GETARG_POINTER(0), CBORENTRY_TYPE_ARRAY));
+}
+
+PG_FUNCTION_INFO_V1(cbor_map_agg_transfn);
+Datum
+cbor_map_agg_transfn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	CborBuilder *builder;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "cbor_map_agg_transfn called in non-aggregate context");
+
+	builder = PG_ARGISNULL(0) ? cbor_builder_create(aggcontext) : (CborBuilder *) PG_GETARG_POINTER(0);
+	cbor_builder_add_datum(fcinfo, builder, 1);
+	cbor_builder_add_datum(fcinfo, builder, 2);
+
+	PG_RETURN_POINTER(builder);
+}
+
+PG_FUNCTION_INFO_V1(cbor_map_agg_finalfn);
+Datum
+cbor_map_agg_finalfn(PG_FUNCTION_ARGS)
+{
+	if (PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+
+	PG_RETURN_CBOR(cbor_builder_finish((CborBuilder *) PG_GETARG_POINTER(0), CBORENTRY_TYPE_MAP));
+}
+
+/*
+ * The partial states of parallel aggregation are appended to each other,
+ * shifting the end offsets of the appended entries.  The partial state of a
+ * worker which did not see any rows is NULL, so two NULL states combine to
+ * NULL and a single state is copied into the aggregate context.
+ */
+PG_FUNCTION_INFO_V1(cbor_agg_combinefn);
+Datum
+cbor_agg_combinefn(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	CborBuilder *state1;
+	CborBuilder *state2;
+	int32		i;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "cbor_agg_combinefn called in non-aggregate context");
+
+	if (PG_ARGISNULL(1))
+	{
+		if (PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	state1 = PG_ARGISNULL(0) ? cbor_builder_create(aggcontext) : (CborBuilder *) PG_GETARG_POINTER(0);
+	state2 = (CborBuilder *) PG_GETARG_POINTER(1);
+
+	for (i = 0; i < state2->count; ++i)
+	{
+		uint32		off = CBORENTRY_OFF(state2->entries, i);
+
+		cbor_builder_add(state1, state2->entries[i] & CBORENTRY_TYPEMASK, state2->values.data + off,
+						 CBORENTRY_ENDPOS(state2->entries, i) - off);
+	}
+
+	PG_RETURN_POINTER(state1);
+}
+
+/*
+ * The serialized state is the number of entries followed by the entries
+ * and the values.
+ */
+PG_FUNCTION_INFO_V1(cbor_agg_serialize);
+Datum
+cbor_agg_serialize(PG_FUNCTION_ARGS)
+{
+	CborBuilder *builder = (CborBuilder *) PG_GETARG_POINTER(0);
+	Size		entrieslen = builder->count * sizeof(CborEntry);
+	Size		size = VARHDRSZ + sizeof(int32) + entrieslen + builder->values.len;
+	bytea	   *result = palloc(size);
+	char	   *data = VARDATA(result);
+
+	SET_VARSIZE(result, size);
+	memcpy(data, &builder->count, sizeof(int32));
+	memcpy(data + sizeof(int32), builder->entries, entrieslen);
+	memcpy(data + sizeof(int32) + entrieslen, builder->values.data, builder->values.len);
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+PG_FUNCTION_INFO_V1(cbor_agg_deserialize);
+Datum
+cbor_agg_deserialize(PG_FUNCTION_ARGS)
+{
+	bytea	   *state = PG_GETARG_BYTEA_PP(0);
+	const char *data = VARDATA_ANY(state);
+	MemoryContext aggcontext;
+	CborBuilder *builder;
+	int32		count;
+
+	if (!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR, "cbor_agg_deserialize called in non-aggregate context");
+
+	memcpy(&count, data, sizeof(int32));
+	data += sizeof(int32);
+
+	builder = cbor_builder_create(aggcontext);
+	if (count > builder->allocated)
+	{
+		builder->allocated = count;
+		builder->entries = repalloc(builder->entries, count * sizeof(CborEntry));
+	}
+	builder->count = count;
+	memcpy(builder->entries, data, count * sizeof(CborEntry));
+	data += count * sizeof(CborEntry);
+	appendBinaryStringInfo(&builder->values, data, VARSIZE_ANY_EXHDR(state) - sizeof(int32) - count * sizeof(CborEntry));
+
+	PG_RETURN_POINTER(builder);
+}
+
+
+static CborBuilder *
+cbor_builder_create(MemoryContext context)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(context);
+	CborBuilder *builder = palloc(sizeof(CborBuilder));
+
+	builder->count = 0;
+	builder->allocated = 16;
+	builder->entries = palloc(builder->allocated * sizeof(CborEntry));
+	initStringInfo(&builder->values);
+
+	MemoryContextSwitchTo(oldcontext);
+	return builder;
+}
+
+static void
+cbor_builder_add(CborBuilder * builder, CborEntry type, const char *value, Size len)
+{
+	cbor_check_size(offsetof(CborContainer, entries) + (builder->count + 1) * sizeof(CborEntry) + builder->values.len + len);
+
+	if (builder->count == builder->allocated)
+	{
+		builder->allocated *= 2;
+		builder->entries = repalloc(builder->entries, builder->allocated * sizeof(CborEntry));
+	}
+
+	appendBinaryStringInfo(&builder->values, value, len);
+	builder->entries[builder->count++] = type | builder->values.len;
+}
+
+static Cbor *
+cbor_builder_finish(CborBuilder * builder, CborEntry type)
+{
+	int32		count = type == CBORENTRY_TYPE_MAP ? builder->count / 2 : builder->count;
+	Size		entrieslen = builder->count * sizeof(CborEntry);
+	Size		size = offsetof(CborContainer, entries) + entrieslen + builder->values.len;
+	CborContainer *container;
+	Cbor	   *result;
+
+	if (type == CBORENTRY_TYPE_MAP)
+		size += CBORCONTAINER_SORTSIZE(count);
+	cbor_check_size(size);
+
+	result = palloc(offsetof(Cbor, root) + sizeof(CborEntry) + size);
+	SET_VARSIZE(result, offsetof(Cbor, root) + sizeof(CborEntry) + size);
+	result->root = type | size;
+
+	container = (CborContainer *) (&result->root + 1);
+	container->count = count;
+	memcpy(container->entries, builder->entries, entrieslen);
+	memcpy((char *) container->entries + entrieslen, builder->values.data, builder->values.len);
+
+	if (type == CBORENTRY_TYPE_MAP)
+		cbor_sort_map(container);
+
+	return result;
+}
+
+/*
+ * Append argument argno converted to cbor.  SQL NULL becomes null, cbor
+ * values are taken as they are, booleans, numbers, strings and bytea become
+ * their cbor counterparts and all other types their text representation.
+ */
+static void
+cbor_builder_add_datum(FunctionCallInfo fcinfo, CborBuilder * builder, int argno)
+{
+	CborConverter *converters = fcinfo->flinfo->fn_extra;
+	CborConverter *conv;
+	Datum		value = PG_GETARG_DATUM(argno);
+	Cbor	   *cbor;
+
+	if (converters == NULL)
+	{
+		Oid			outfunc;
+		bool		isvarlena;
+		int			i;
+
+		converters = MemoryContextAlloc(fcinfo->flinfo->fn_mcxt, sizeof(CborConverter) * PG_NARGS());
+		for (i = 1; i < PG_NARGS(); ++i)
+		{
+			converters[i].typid = getBaseType(get_fn_expr_argtype(fcinfo->flinfo, i));
+			if (!OidIsValid(converters[i].typid))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not determine input data type")));
+
+			getTypeOutputInfo(converters[i].typid, &outfunc, &isvarlena);
+			fmgr_info_cxt(outfunc, &converters[i].outfunc, fcinfo->flinfo->fn_mcxt);
+			converters[i].is_cbor = converters[i].outfunc.fn_addr == cbor_out;
+			converters[i].is_cbor_raw = converters[i].outfunc.fn_addr == cbor_raw_out;
+		}
+		fcinfo->flinfo->fn_extra = converters;
+	}
+	conv = &converters[argno];
+
+	if (PG_ARGISNULL(argno))
+		cbor = cbor_make_scalar(CBORENTRY_TYPE_FLOATORSIMPLE, CBOR_SIMPLE_VALUE | CBOR_SIMPLE_NULL);
+	else if (conv->is_cbor)
+		cbor = DatumGetCbor(PG_DETOAST_DATUM(value));
+	else if (conv->is_cbor_raw)
+		cbor = DatumGetCbor(DirectFunctionCall1(cbor_raw_to_cbor, value));
+	else
+	{
+		switch (conv->typid)
+		{
+			case BOOLOID:
+				cbor = cbor_make_scalar(CBORENTRY_TYPE_FLOATORSIMPLE, CBOR_SIMPLE_VALUE | (DatumGetBool(value) ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE));
+				break;
+
+			case INT2OID:
+				cbor = cbor_make_int(DatumGetInt16(value));
+				break;
+
+			case INT4OID:
+				cbor = cbor_make_int(DatumGetInt32(value));
+				break;
+
+			case INT8OID:
+				cbor = cbor_make_int(DatumGetInt64(value));
+				break;
+
+			case FLOAT4OID:
+				cbor = cbor_make_float(DatumGetFloat4(value));
+				break;
+
+			case FLOAT8OID:
+				cbor = cbor_make_float(DatumGetFloat8(value));
+				break;
+
+			case NUMERICOID:
+				cbor = cbor_make_numeric(DatumGetNumeric(value));
+				break;
+
+			case BYTEAOID:
+				{
+					bytea	   *data = DatumGetByteaPP(value);
+
+					cbor = cbor_make_string(CBORENTRY_TYPE_BYTESTRING, VARDATA_ANY(data), VARSIZE_ANY_EXHDR(data));
+					break;
+				}
+
+			case TEXTOID:
+			case VARCHAROID:
+				{
+					text	   *data = DatumGetTextPP(value);
+
+					cbor = cbor_make_string(CBORENTRY_TYPE_TEXTSTRING, VARDATA_ANY(data), VARSIZE_ANY_EXHDR(data));
+					break;
+				}
+
+			default:
+				{
+					char	   *str = OutputFunctionCall(&conv->outfunc, value);
+
+					cbor = cbor_make_string(CBORENTRY_TYPE_TEXTSTRING, str, strlen(str));
+					break;
+				}
+		}
+	}
+
+	cbor_builder_add(builder, cbor->root & CBORENTRY_TYPEMASK, (char *) (&cbor->root + 1), CBORENTRY_ENDPOS(&cbor->root, 0));
+
+	if ((Pointer) cbor != DatumGetPointer(value))
+		pfree(cbor);
+}
+
+static Cbor *
+cbor_make_scalar(CborEntry type, uint64 value)
+{
+	Size		len = cbor_put_scalar(NULL, type, value);
+	Cbor	   *result = palloc(offsetof(Cbor, root) + sizeof(CborEntry) + len);
+
+	SET_VARSIZE(result, offsetof(Cbor, root) + sizeof(CborEntry) + len);
+	result->root = type | len;
+	cbor_put_scalar((char *) (&result->root + 1), type, value);
+
+	return result;
+}
+
+static Cbor *
+cbor_make_string(CborEntry type, const char *str, Size len)
+{
+	Size		size = INTALIGN(VARHDRSZ + len);
+	Cbor	   *result;
+
+	cbor_check_size(size);
+	result = palloc0(offsetof(Cbor, root) + sizeof(CborEntry) + size);
+	SET_VARSIZE(result, offsetof(Cbor, root) + sizeof(CborEntry) + size);
+	result->root = type | size;
+	CBORENTRY_SETSTRLEN(&result->root, 0, 1, len);
+	memcpy(CBORENTRY_GETSTR(&result->root, 0, 1), str, len);
+
+	return result;
+}
+
+static Cbor *
+cbor_make_int(int64 value)
+{
+	if (value < 0)
+		return cbor_make_scalar(CBORENTRY_TYPE_NEGATIVEINTEGER, (uint64) (-1 - value));
+	return cbor_make_scalar(CBORENTRY_TYPE_UNSIGNEDINTEGER, (uint64) value);
+}
+
+static Cbor *
+cbor_make_float(double value)
+{
+	uint64		bits;
+
+	if (isnan(value))
+		value = NAN;
+	memcpy(&bits, &value, sizeof(bits));
+
+	return cbor_make_scalar(CBORENTRY_TYPE_FLOATORSIMPLE, bits);
+}
+
+/*
+ * Integral numerics within the range of cbor integers, which is -2^64 to
+ * 2^64 - 1, become integers whatever their scale, so 1.0 becomes 1, and all
+ * others floats.  Integers beyond bigint are shifted by 2^63 towards zero to
+ * convert them.
+ */
+Cbor *
+cbor_make_numeric(Numeric num)
+{
+	Datum		datum = NumericGetDatum(num);
+	Datum		min;
+	Datum		max;
+	Datum		shifted;
+
+	if (numeric_is_nan(num) ||
+		!DatumGetBool(DirectFunctionCall2(numeric_eq, datum, DirectFunctionCall2(numeric_trunc, datum, Int32GetDatum(0)))))
+		return cbor_make_float(DatumGetFloat8(DirectFunctionCall1(numeric_float8_no_overflow, datum)));
+
+	min = DirectFunctionCall1(int8_numeric, Int64GetDatum(PG_INT64_MIN));
+	max = DirectFunctionCall1(int8_numeric, Int64GetDatum(PG_INT64_MAX));
+
+	if (DatumGetBool(DirectFunctionCall2(numeric_lt, datum, min)))
+	{
+		shifted = DirectFunctionCall2(numeric_sub, datum, min);
+		if (DatumGetBool(DirectFunctionCall2(numeric_ge, shifted, min)))
+			return cbor_make_scalar(CBORENTRY_TYPE_NEGATIVEINTEGER, (uint64) PG_INT64_MAX - (uint64) DatumGetInt64(DirectFunctionCall1(numeric_int8, shifted)));
+	}
+	else if (DatumGetBool(DirectFunctionCall2(numeric_gt, datum, max)))
+	{
+		shifted = DirectFunctionCall2(numeric_add, datum, min);
+		if (DatumGetBool(DirectFunctionCall2(numeric_le, shifted, max)))
+			return cbor_make_scalar(CBORENTRY_TYPE_UNSIGNEDINTEGER, (uint64) DatumGetInt64(DirectFunctionCall1(numeric_int8, shifted)) + ((uint64) 1 << 63));
+	}
+	else
+		return cbor_make_int(DatumGetInt64(DirectFunctionCall1(numeric_int8, datum)));
+
+	return cbor_make_float(DatumGetFloat8(DirectFunctionCall1(numeric_float8_no_overflow, datum)));
+}
+
+/*
+ * Look up path element i in node, expanding it, and return the position of
+ * the found item or -1.  For arrays index is set to the parsed index.
+ */
+static int32
+cbor_node_step(ExpandedCbor * ecb, CborNode * node, Datum *elems, bool *nulls, int32 i, int32 *index)
+{
+	text	   *elem;
+
+	if (nulls[i])
+		ereport(ERROR,
+				(errcode(ERRCODE_NULL_VALUE_NOT_ALLOWED),
+				 errmsg("path element at position %d is null", i + 1)));
+
+	elem = DatumGetTextPP(elems[i]);
+
+	switch (node->type)
+	{
+		case CBORENTRY_TYPE_MAP:
+			return cbor_node_find_key(ecb, node, VARDATA_ANY(elem), VARSIZE_ANY_EXHDR(elem));
+
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				char	   *str = text_to_cstring(elem);
+				char	   *end;
+				long		value;
+
+				errno = 0;
+				value = strtol(str, &end, 10);
+				if (end == str || *end != '\0' || errno != 0 || value < PG_INT32_MIN || value > PG_INT32_MAX)
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+							 errmsg("path element at position %d is not an integer: \"%s\"", i + 1, str)));
+
+				cbor_node_expand(ecb, node);
+				*index = value;
+				if (value < 0)
+					value += node->count;
+				if (value < 0 || value >= node->count)
+					return -1;
+				return value;
+			}
+	}
+
+	return -1;
+}
+
+/*
+ * Turn a node that is not an array into an expanded array holding it as its
+ * only element.
+ */
+static void
+cbor_node_wrap(ExpandedCbor * ecb, CborNode * node)
+{
+	CborNode	item = *node;
+
+	if (node->type == CBORENTRY_TYPE_ARRAY)
+	{
+		cbor_node_expand(ecb, node);
+		return;
+	}
+
+	node->type = CBORENTRY_TYPE_ARRAY;
+	node->entry = NULL;
+	node->count = 0;
+	node->allocated = 0;
+	node->items = NULL;
+	node->owned = NULL;
+	*cbor_node_insert(ecb, node, 0, 1) = item;
+}
+
+/*
+ * Set a node to a copy of the flat value of an item not expanded.
+ */
+static void
+cbor_node_copy(ExpandedCbor * ecb, CborNode * node, CborNode * item)
+{
+	Assert(item->entry != NULL);
+
+	cbor_node_set(ecb, node, cbor_from_entry(item->entry, item->nr, item->cnt));
+}
+
+static bool
+cbor_node_key_equals(CborNode * key, CborEntry type, const char *str, int32 len, uint64 uint)
+{
+	if (key->type != type)
+		return false;
+	if (str)
+		return CBORENTRY_STRLEN(key->entry, key->nr, key->cnt) == len &&
+			memcmp(CBORENTRY_GETSTR(key->entry, key->nr, key->cnt), str, len) == 0;
+	return cbor_get_scalar(key->entry, key->nr, key->cnt) == uint;
+}
+
+/*
+ * Remove the pairs of a map whose key equals the given text string or
+ * integer.  For arrays text strings are matched against the elements and
+ * integers are used as index.
+ */
+static Datum
+cbor_delete_key(Datum datum, CborEntry type, const char *str, int32 len, uint64 uint)
+{
+	ExpandedCbor *ecb = DatumGetExpandedCbor(datum);
+	CborNode   *node = &ecb->root;
+	int32		i;
+
+	switch (node->type)
+	{
+		case CBORENTRY_TYPE_MAP:
+			cbor_node_expand(ecb, node);
+			for (i = node->count - 2; i >= 0; i -= 2)
+			{
+				if (cbor_node_key_equals(&node->items[i], type, str, len, uint))
+					cbor_node_remove(ecb, node, i, 2);
+			}
+			break;
+
+		case CBORENTRY_TYPE_ARRAY:
+			cbor_node_expand(ecb, node);
+			if (str)
+			{
+				for (i = node->count - 1; i >= 0; --i)
+				{
+					if (cbor_node_key_equals(&node->items[i], type, str, len, uint))
+						cbor_node_remove(ecb, node, i, 1);
+				}
+			}
+			else
+			{
+				int64		index = type == CBORENTRY_TYPE_NEGATIVEINTEGER ? node->count - 1 - (int64) uint : (int64) uint;
+
+				if (index >= 0 && index < node->count)
+					cbor_node_remove(ecb, node, index, 1);
+			}
+			break;
+
+		default:
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("cannot delete from a cbor value that is not an array or a map")));
+	}
+
+	return ExpandedCborGetDatum(ecb);
+}
+
+static bool
+cbor_entry_is_null(CborEntry * entry, int32 nr, int32 cnt)
+{
+	uint64		value;
+
+	if ((entry[nr] & CBORENTRY_TYPEMASK) != CBORENTRY_TYPE_FLOATORSIMPLE)
+		return false;
+
+	value = cbor_get_scalar(entry, nr, cnt);
+	return value == (CBOR_SIMPLE_VALUE | CBOR_SIMPLE_NULL) || value == (CBOR_SIMPLE_VALUE | CBOR_SIMPLE_UNDEFINED);
+}
+
+static void
+cbor_cannot_cast(CborEntry * entry, int32 nr, int32 cnt, const char *prefix, Oid typid)
+{
+	const char *name;
+	uint64		value;
+
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			name = "integer";
+			break;
+		case CBORENTRY_TYPE_BYTESTRING:
+			name = "byte string";
+			break;
+		case CBORENTRY_TYPE_TEXTSTRING:
+			name = "text string";
+			break;
+		case CBORENTRY_TYPE_ARRAY:
+			name = "array";
+			break;
+		case CBORENTRY_TYPE_MAP:
+			name = "map";
+			break;
+		case CBORENTRY_TYPE_TAG:
+			name = "tag";
+			break;
+		default:
+			value = cbor_get_scalar(entry, nr, cnt);
+			if (value == (CBOR_SIMPLE_VALUE | CBOR_SIMPLE_FALSE) || value == (CBOR_SIMPLE_VALUE | CBOR_SIMPLE_TRUE))
+				name = "boolean";
+			else if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				name = "simple value";
+			else
+				name = "float";
+			break;
+	}
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("cannot cast cbor %s%s to type %s", prefix, name, format_type_be(typid))));
+}
+
+/*
+ * Convert seconds since the Unix epoch to a timestamp, using integer
+ * arithmetic for integers so no microseconds are lost.
+ */
+static TimestampTz
+cbor_epoch_to_timestamptz(CborEntry * entry, int32 nr, int32 cnt)
+{
+	const int64 epoch = (int64) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY;
+	const int64 limit = PG_INT64_MAX / USECS_PER_SEC;
+	uint64		value = cbor_get_scalar(entry, nr, cnt);
+	TimestampTz result = 0;
+	bool		valid;
+	double		dbl;
+
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+			valid = value <= (uint64) (limit + epoch);
+			if (valid)
+				result = ((int64) value - epoch) * USECS_PER_SEC;
+			break;
+
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			valid = value < (uint64) (limit - epoch);
+			if (valid)
+				result = (-1 - (int64) value - epoch) * USECS_PER_SEC;
+			break;
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				cbor_cannot_cast(entry, nr, cnt, "tag 1 of ", TIMESTAMPTZOID);
+
+			memcpy(&dbl, &value, sizeof(dbl));
+			if (isnan(dbl))
+				ereport(ERROR,
+						(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+						 errmsg("timestamp cannot be NaN")));
+			if (isinf(dbl))
+			{
+				if (dbl < 0)
+					TIMESTAMP_NOBEGIN(result);
+				else
+					TIMESTAMP_NOEND(result);
+				return result;
+			}
+
+			dbl = rint((dbl - epoch) * USECS_PER_SEC);
+			valid = dbl >= (double) PG_INT64_MIN && dbl < -(double) PG_INT64_MIN;
+			if (valid)
+				result = (int64) dbl;
+			break;
+
+		default:
+			cbor_cannot_cast(entry, nr, cnt, "tag 1 of ", TIMESTAMPTZOID);
+			return 0;
+	}
+
+#ifdef IS_VALID_TIMESTAMP
+	valid = valid && IS_VALID_TIMESTAMP(result);
+#else
+	valid = valid && !TIMESTAMP_NOT_FINITE(result);
+#endif
+	if (!valid)
+		ereport(ERROR,
+				(errcode(ERRCODE_DATETIME_VALUE_OUT_OF_RANGE),
+				 errmsg("timestamp out of range")));
+
+	return result;
+}
@@ -0,0 +1,168 @@
+#include "cbor.h"
+#include "access/gin.h"
+#include "access/hash.h"
+#include "miscadmin.h"
+
+typedef struct CborGinEntries
+{
+	Datum	   *entries;
+	int32		count;
+	int32		allocated;
+}	CborGinEntries;
+
+#define CBOR_GIN_ROTATE(hash) (((hash) << 1) | ((hash) >> 31))
+
+static void cbor_gin_add(CborGinEntries * result, uint32 hash);
+static void cbor_gin_extract(CborGinEntries * result, uint32 hash, CborEntry * entry, int32 nr, int32 cnt);
+
+
+/*
+ * The GIN operator class indexes one hash for every scalar in a value,
+ * combined from the keys of all maps and the numbers of all tags on its
+ * path.  Arrays do not contribute to the path, so a value contains another
+ * one only if it has all hashes of the other value.
+ */
+PG_FUNCTION_INFO_V1(gin_extract_cbor);
+Datum
+gin_extract_cbor(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	CborGinEntries result;
+
+	result.count = 0;
+	result.allocated = 16;
+	result.entries = palloc(result.allocated * sizeof(Datum));
+
+	cbor_gin_extract(&result, 0, &cbor->root, 0, 1);
+
+	*nentries = result.count;
+	PG_RETURN_POINTER(result.entries);
+}
+
+PG_FUNCTION_INFO_V1(gin_extract_cbor_query);
+Datum
+gin_extract_cbor_query(PG_FUNCTION_ARGS)
+{
+	int32	   *nentries = (int32 *) PG_GETARG_POINTER(1);
+	StrategyNumber strategy = PG_GETARG_UINT16(2);
+	int32	   *searchMode = (int32 *) PG_GETARG_POINTER(6);
+	Datum	   *entries;
+
+	if (strategy != CborContainsStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	entries = (Datum *) DatumGetPointer(DirectFunctionCall3(gin_extract_cbor,
+															PG_GETARG_DATUM(0),
+															PointerGetDatum(nentries),
+															PointerGetDatum(NULL)));
+
+	/* a query without scalars, like {} or [], is contained in every value */
+	if (*nentries == 0)
+		*searchMode = GIN_SEARCH_MODE_ALL;
+
+	PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(gin_consistent_cbor);
+Datum
+gin_consistent_cbor(PG_FUNCTION_ARGS)
+{
+	bool	   *check = (bool *) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = PG_GETARG_UINT16(1);
+	int32		nkeys = PG_GETARG_INT32(3);
+	bool	   *recheck = (bool *) PG_GETARG_POINTER(5);
+	int32		i;
+
+	if (strategy != CborContainsStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	/* the hashes may collide and do not cover the structure of arrays */
+	*recheck = true;
+
+	for (i = 0; i < nkeys; ++i)
+	{
+		if (!check[i])
+			PG_RETURN_BOOL(false);
+	}
+
+	PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(gin_triconsistent_cbor);
+Datum
+gin_triconsistent_cbor(PG_FUNCTION_ARGS)
+{
+	GinTernaryValue *check = (GinTernaryValue *) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = PG_GETARG_UINT16(1);
+	int32		nkeys = PG_GETARG_INT32(3);
+	int32		i;
+
+	if (strategy != CborContainsStrategyNumber)
+		elog(ERROR, "unrecognized strategy number: %d", strategy);
+
+	for (i = 0; i < nkeys; ++i)
+	{
+		if (check[i] == GIN_FALSE)
+			PG_RETURN_GIN_TERNARY_VALUE(GIN_FALSE);
+	}
+
+	PG_RETURN_GIN_TERNARY_VALUE(GIN_MAYBE);
+}
+
+
+static void
+cbor_gin_add(CborGinEntries * result, uint32 hash)
+{
+	if (result->count == result->allocated)
+	{
+		result->allocated *= 2;
+		result->entries = repalloc(result->entries, result->allocated * sizeof(Datum));
+	}
+
+	result->entries[result->count++] = Int32GetDatum(hash);
+}
+
+static void
+cbor_gin_extract(CborGinEntries * result, uint32 hash, CborEntry * entry, int32 nr, int32 cnt)
+{
+	int32		i;
+
+	check_stack_depth();
+
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				for (i = 0; i < value->count; ++i)
+					cbor_gin_extract(result, hash, value->entries, i, value->count);
+				break;
+			}
+
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count2 = CBORCONTAINER_COUNT(value) * 2;
+
+				for (i = 0; i < count2; i += 2)
+					cbor_gin_extract(result, CBOR_GIN_ROTATE(hash) ^ cbor_hash_entry(value->entries, i, count2),
+									 value->entries, i + 1, count2);
+				break;
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				hash = CBOR_GIN_ROTATE(hash) ^ DatumGetUInt32(hash_any((unsigned char *) &value->value, sizeof(value->value)));
+				cbor_gin_extract(result, hash, &value->entry, 0, 1);
+				break;
+			}
+
+		default:
+			cbor_gin_add(result, CBOR_GIN_ROTATE(hash) ^ cbor_hash_entry(entry, nr, cnt));
+			break;
+	}
+}
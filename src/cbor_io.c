@@ -1,288 +1,135 @@
 #include "cbor.h"
 #include <inttypes.h>
 
+#include "funcapi.h"
+#include "libpq/be-fsstubs.h"
+#include "libpq/libpq-fs.h"
 #include "libpq/pqformat.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
 
+#if PG_VERSION_NUM < 110000
+#define be_lo_open lo_open
+#define be_lo_close lo_close
+#endif
 
-PG_MODULE_MAGIC;
-
-extern int	cbor_yyparse(Cbor ** result);
-extern void cbor_yyerror(Cbor ** result, const char *message);
-extern void cbor_scanner_init(const char *str);
-extern void cbor_scanner_finish(void);
-
-
-static double		cbor_decode_half(uint64 value);
-static Datum cbor_decoder(StringInfo inbuf);
-static void		cbor_send_type_and_uint64_value(StringInfo buf, uint8 first_byte, uint64 value);
-static void cbor_send_helper(StringInfo buf, CborEntry * cbor, int32 nr, int32 cnt);
-static uint64 cbor_recv_helper_value(StringInfo inbuf, unsigned int first_byte);
-static void		cbor_recv_helper(StringInfo inbuf, StringInfo outbuf, int offset, CborEntry * entry);
-static void cbor_out_helper(StringInfo buf, CborEntry * cbor, int32 nr, int32 cnt);
-
+/* bytes read from a large object at a time */
+#define CBOR_SEQUENCE_CHUNK 65536
 
-typedef enum
+/*
+ * The input of cbor_decode_sequence, held in buf with its cursor at the next
+ * item.  A large object is read into buf in chunks as items are needed.
+ */
+typedef struct CborSequence
 {
-	CborAdditionalBytes1 = 24,
-	CborAdditionalBytes2 = 25,
-	CborAdditionalBytes4 = 26,
-	CborAdditionalBytes8 = 27
-} CborAdditionalBytes;
+	StringInfoData buf;
+	int32		fd;				/* large object descriptor, or -1 */
+	bool		eof;
+}	CborSequence;
 
+PG_MODULE_MAGIC;
 
-PG_FUNCTION_INFO_V1(cbor_in);
-Datum
-cbor_in(PG_FUNCTION_ARGS)
-{
-	char	   *str = PG_GETARG_CSTRING(0);
-	Cbor	   *result;
+void		_PG_init(void);
 
-	cbor_scanner_init(str);
+static Datum cbor_decoder(StringInfo inbuf);
+static Datum cbor_encode_helper(FunctionCallInfo fcinfo, bool canonical);
+static Datum cbor_sequence_next(FunctionCallInfo fcinfo);
+static void cbor_sequence_read(CborSequence * seq, MemoryContext context);
 
-	if (cbor_yyparse(&result) != 0)
-		cbor_yyerror(&result, "bogus input");
 
-	cbor_scanner_finish();
+static const struct config_enum_entry cbor_jsonb_bytes_options[] = {
+	{"base64url", CBOR_JSONB_BYTES_BASE64URL, false},
+	{"base64", CBOR_JSONB_BYTES_BASE64, false},
+	{"hex", CBOR_JSONB_BYTES_HEX, false},
+	{NULL, 0, false}
+};
 
-	PG_RETURN_CBOR(result);
-}
+static const struct config_enum_entry cbor_jsonb_tags_options[] = {
+	{"value", CBOR_JSONB_TAGS_VALUE, false},
+	{"object", CBOR_JSONB_TAGS_OBJECT, false},
+	{"error", CBOR_JSONB_TAGS_ERROR, false},
+	{NULL, 0, false}
+};
 
-double
-cbor_decode_half(uint64 value)
-{
-	uint64		sign = value & 0x8000;
-	uint64		exponent = value & 0x7c00;
-	uint64		fraction = value & 0x03ff;
-
-	if (exponent == 0x7c00)
-		exponent = 0x7ff << 10;
-	else if (exponent)
-		exponent += (1023 - 15) << 10;
-	else if (fraction)
-		return ldexpf(fraction, -24);
-
-	value = sign << 48 | exponent << 42 | fraction << 42;
-	return *((double *) &value);
-}
 
-uint64 cbor_recv_helper_value(StringInfo inbuf, unsigned int first_byte)
+void
+_PG_init(void)
 {
-	if (first_byte < CborAdditionalBytes1)
-		return first_byte;
-	if (first_byte == CborAdditionalBytes1)
-		return pq_getmsgint(inbuf, 1);
-	if (first_byte == CborAdditionalBytes2)
-		return pq_getmsgint(inbuf, 2);
-	if (first_byte == CborAdditionalBytes4)
-		return pq_getmsgint(inbuf, 4);
-	if (first_byte == CborAdditionalBytes8)
-		return (uint64) pq_getmsgint64(inbuf);
-	if (first_byte != CBORENTRY_INDEFINITE)
-		ereport(ERROR,
-				(errcode(0),
-				errmsg("invalid length type (%d)",
-						first_byte)));
-	return 0;
+	DefineCustomEnumVariable("cbor.jsonb_bytes",
+							 "Sets the encoding of byte strings converted to jsonb.",
+							 "Byte strings become jsonb strings in base64url, base64 or hex encoding.",
+							 &cbor_jsonb_bytes,
+							 CBOR_JSONB_BYTES_BASE64URL,
+							 cbor_jsonb_bytes_options,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomEnumVariable("cbor.jsonb_tags",
+							 "Sets how tags are converted to jsonb.",
+							 "With value only the tagged value is converted, with object tags become {\"tag\": tag, \"value\": value} and with error they are rejected.",
+							 &cbor_jsonb_tags,
+							 CBOR_JSONB_TAGS_VALUE,
+							 cbor_jsonb_tags_options,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("cbor.track_stats",
+							 "Collects statistics about the work of cbor functions.",
+							 "The counters of the current session are shown by cbor_stats() and reset by cbor_stats_reset().",
+							 &cbor_track_stats,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	EmitWarningsOnPlaceholders("cbor");
 }
 
-void
-cbor_recv_helper(StringInfo inbuf, StringInfo outbuf, int offset, CborEntry * entry)
+PG_FUNCTION_INFO_V1(cbor_in);
+Datum
+cbor_in(PG_FUNCTION_ARGS)
 {
-	unsigned int first_byte;
-	int32		i;
-	CborEntry	type;
-	uint64		value;
-	int			requiredSize = 0;
-	void	   *data;
-
-	first_byte = pq_getmsgint(inbuf, 1);
-
-	type = (first_byte << 24) & CBORENTRY_TYPEMASK;
-	first_byte &= 0x1f;
-	value = cbor_recv_helper_value(inbuf, first_byte);
-
-	if (first_byte == CBORENTRY_INDEFINITE && (type == CBORENTRY_TYPE_UNSIGNEDINTEGER || type == CBORENTRY_TYPE_NEGATIVEINTEGER || type == CBORENTRY_TYPE_TAG || type == CBORENTRY_TYPE_FLOATORSIMPLE))
-		ereport(ERROR,
-				(errcode(0),
-				errmsg("type %d does not support indefinite values",
-						type >> 29)));
-
-	switch (type)
-	{
-		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
-		case CBORENTRY_TYPE_NEGATIVEINTEGER:
-			requiredSize = sizeof(uint64);
-			break;
-		case CBORENTRY_TYPE_BYTESTRING:
-		case CBORENTRY_TYPE_TEXTSTRING:
-			requiredSize = INTALIGN(VARHDRSZ + value);
-			break;
-		case CBORENTRY_TYPE_ARRAY:
-			requiredSize = sizeof(int32) + value * sizeof(CborEntry);
-			break;
-		case CBORENTRY_TYPE_MAP:
-			requiredSize = sizeof(int32) + value * sizeof(CborEntry) * 2;
-			break;
-		case CBORENTRY_TYPE_TAG:
-			requiredSize = sizeof(uint64) + sizeof(CborEntry);
-			break;
-		case CBORENTRY_TYPE_FLOATORSIMPLE:
-			requiredSize = sizeof(double);
-			break;
-	}
-
-	enlargeStringInfo(outbuf, requiredSize);
-	data = outbuf->data + outbuf->len;
-	outbuf->len += requiredSize;
-
-	switch (type)
-	{
-		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
-		case CBORENTRY_TYPE_NEGATIVEINTEGER:
-			*((uint64 *) data) = value;
-			break;
-
-		case CBORENTRY_TYPE_BYTESTRING:
-		case CBORENTRY_TYPE_TEXTSTRING:
-			{
-				char	   *target = VARDATA(data);
-
-				if (first_byte == CBORENTRY_INDEFINITE)
-				{
-					unsigned int first_byte;
-
-					while ((first_byte = pq_getmsgint(inbuf, 1)) != CBORENTRY_BREAK)
-					{
-						uint64 len;
-
-						if (((first_byte << 24) & CBORENTRY_TYPEMASK) != type)
-							ereport(ERROR,
-									(errcode(0),
-									errmsg("invalid type %d in indefinite value of type %d",
-											first_byte >> 5, type >> 29)));
-						first_byte &= 0x1F;
-						if (first_byte == CBORENTRY_INDEFINITE)
-							ereport(ERROR,
-									(errcode(0),
-									errmsg("indefinite value in indefinite value of type %d",
-											type >> 29)));
-
-						len = cbor_recv_helper_value(inbuf, first_byte);
-						enlargeStringInfo(outbuf, INTALIGN(value + len));
-						pq_copymsgbytes(inbuf, outbuf->data + outbuf->len + value, len);
-						value += len;
-					}
-
-					data = outbuf->data + outbuf->len - requiredSize;
-					target = VARDATA(data);
-					outbuf->len += INTALIGN(value);
-				}
-				else
-					pq_copymsgbytes(inbuf, target, value);
-
-				SET_VARSIZE(data, value + VARHDRSZ);
-				for (i = 0; i < INTALIGN(VARHDRSZ + value) - VARHDRSZ - value; ++i)
-					target[value + i] = 0;
-				break;
-			}
-
-		case CBORENTRY_TYPE_ARRAY:
-		case CBORENTRY_TYPE_MAP:
-			{
-				CborContainer *container = data;
-				int			len = outbuf->len;
-				bool is_map = type == CBORENTRY_TYPE_MAP;
-
-				if (first_byte == CBORENTRY_INDEFINITE)
-				{
-					StringInfoData tempbuf;
-					unsigned int first_byte;
-
-					initStringInfo(&tempbuf);
-
-					while ((first_byte = pq_getmsgint(inbuf, 1)) != CBORENTRY_BREAK)
-					{
-						inbuf->cursor -= 1;
-						enlargeStringInfo(outbuf, sizeof(CborEntry));
-						cbor_recv_helper(inbuf, &tempbuf, 0, (CborEntry*)(outbuf->data + outbuf->len));
-						outbuf->len += sizeof(CborEntry);
-						value += 1;
-					}
-
-					container = (CborContainer*)(outbuf->data + len - requiredSize);
-					memmove(outbuf->data + outbuf->len, tempbuf.data, tempbuf.len);
-					outbuf->len += tempbuf.len;
-					pfree(tempbuf.data);
-
-					if (is_map)
-						value /= 2;
-				}
-				else
-				{
-					for (i = 0; i < value * (is_map ? 2 : 1); ++i)
-						cbor_recv_helper(inbuf, outbuf, len, container->entries + i);
-				}
-				container->count = value;
-				break;
-			}
-
-		case CBORENTRY_TYPE_TAG:
-			{
-				CborTag    *tag = data;
-
-				tag->value = value;
-				cbor_recv_helper(inbuf, outbuf, outbuf->len, &tag->entry);
-				break;
-			}
-
-		case CBORENTRY_TYPE_FLOATORSIMPLE:
-			{
-				if (first_byte < CborAdditionalBytes2)
-					*((uint64 *) data) = CBOR_SIMPLE_VALUE | value;
-				else
-				{
-					double		dbl;
-
-					if (first_byte == CborAdditionalBytes2)
-						dbl = cbor_decode_half(value);
-					else if (first_byte == CborAdditionalBytes4)
-					{
-						uint32		val = value;
-
-						dbl = *((float *) &val);
-					}
-					else
-						dbl = *((double *) &value);
-
-					if (isnan(dbl))
-						dbl = NAN;
-
-					*((double *) data) = dbl;
-				}
+	char	   *str = PG_GETARG_CSTRING(0);
+	StringInfoData buf;
+	Datum		result;
 
-				break;
-			}
-	}
+	initStringInfo(&buf);
+	cbor_parse(str, &buf);
+	result = cbor_decoder(&buf);
+	pfree(buf.data);
 
-	*entry = type | (outbuf->len - offset);
+	return result;
 }
 
-Datum
+/*
+ * Decode the next item of inbuf and advance its cursor behind it.
+ */
+static Datum
 cbor_decoder(StringInfo inbuf)
 {
-	StringInfoData outbuf;
-	CborEntry  *entry;
+	instr_time	start;
+	Size		consumed;
+	Cbor	   *result;
 
-	initStringInfo(&outbuf);
-	enlargeStringInfo(&outbuf, VARHDRSZ + sizeof(CborEntry) + inbuf->len);
-	outbuf.len = VARHDRSZ + sizeof(CborEntry);
-	entry = (CborEntry *) (outbuf.data + VARHDRSZ);
+	if (cbor_track_stats)
+		INSTR_TIME_SET_CURRENT(start);
+	cbor_core_stats = cbor_track_stats ? &cbor_counters.core : NULL;
 
-	cbor_recv_helper(inbuf, &outbuf, outbuf.len, entry);
+	result = cbor_core_decode((const uint8 *) inbuf->data + inbuf->cursor, inbuf->len - inbuf->cursor, &consumed);
+	inbuf->cursor += consumed;
 
-	SET_VARSIZE(outbuf.data, outbuf.len);
-	PG_RETURN_CBOR(outbuf.data);
+	if (cbor_track_stats)
+		cbor_stats_add(&cbor_counters.decode, consumed, &start);
+
+	PG_RETURN_CBOR(result);
 }
 
 PG_FUNCTION_INFO_V1(cbor_recv);
@@ -299,168 +146,209 @@ cbor_decode(PG_FUNCTION_ARGS)
 	bytea	   *data = PG_GETARG_BYTEA_P(0);
 	StringInfoData inbuf;
 
-	inbuf.maxlen = inbuf.len = VARSIZE(data);
+	inbuf.maxlen = inbuf.len = VARSIZE(data) - VARHDRSZ;
 	inbuf.data = VARDATA(data);
 	inbuf.cursor = 0;
 
 	return cbor_decoder(&inbuf);
 }
 
-void
-cbor_send_type_and_uint64_value(StringInfo buf, uint8 first_byte, uint64 value)
+/*
+ * Decode a CBOR sequence (RFC 8742), the concatenation of any number of
+ * items, into one row per item.  The items are decoded in place, one per
+ * call.
+ */
+PG_FUNCTION_INFO_V1(cbor_decode_sequence);
+Datum
+cbor_decode_sequence(PG_FUNCTION_ARGS)
 {
-	if (value < CborAdditionalBytes1)
-	{
-		pq_sendbyte(buf, first_byte | (uint8) value);
-	}
-	else if (value <= 0xff)
-	{
-		pq_sendbyte(buf, first_byte | CborAdditionalBytes1);
-		pq_sendint(buf, value, 1);
-	}
-	else if (value <= 0xffff)
+	if (SRF_IS_FIRSTCALL())
 	{
-		pq_sendbyte(buf, first_byte | CborAdditionalBytes2);
-		pq_sendint(buf, value, 2);
+		FuncCallContext *funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		CborSequence *seq = palloc(sizeof(CborSequence));
+		bytea	   *data;
+
+		/*
+		 * Detoast here so that a copy lives as long as the rows.  A value
+		 * which needs no detoasting is passed in for that long anyway.
+		 */
+		data = PG_GETARG_BYTEA_PP(0);
+
+		seq->buf.maxlen = seq->buf.len = VARSIZE_ANY_EXHDR(data);
+		seq->buf.data = VARDATA_ANY(data);
+		seq->buf.cursor = 0;
+		seq->fd = -1;
+		seq->eof = true;
+		funcctx->user_fctx = seq;
+
+		MemoryContextSwitchTo(oldcontext);
 	}
-	else if (value <= 0xffffffff)
-	{
-		pq_sendbyte(buf, first_byte | CborAdditionalBytes4);
-		pq_sendint(buf, value, 4);
-	}
-	else
-	{
-		pq_sendbyte(buf, first_byte | CborAdditionalBytes8);
-		pq_sendint64(buf, value);
-	}
-}
 
+	return cbor_sequence_next(fcinfo);
+}
 
-void
-cbor_send_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt)
+/*
+ * Decode a CBOR sequence stored in a large object.  Only as much of it is
+ * held in memory as the largest item needs.
+ */
+PG_FUNCTION_INFO_V1(cbor_decode_sequence_lo);
+Datum
+cbor_decode_sequence_lo(PG_FUNCTION_ARGS)
 {
-	int32		i;
-	uint8		type = *(entry + nr) >> 24;
-
-	switch (*(entry + nr) & CBORENTRY_TYPEMASK)
+	if (SRF_IS_FIRSTCALL())
 	{
-		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
-		case CBORENTRY_TYPE_NEGATIVEINTEGER:
-			{
-				uint64	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+		FuncCallContext *funcctx = SRF_FIRSTCALL_INIT();
+		MemoryContext oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		CborSequence *seq = palloc(sizeof(CborSequence));
 
-				cbor_send_type_and_uint64_value(buf, type, *value);
-				break;
-			}
-		case CBORENTRY_TYPE_BYTESTRING:
-		case CBORENTRY_TYPE_TEXTSTRING:
-			{
-				int32		len = CBORENTRY_STRLEN(entry, nr, cnt);
+		initStringInfo(&seq->buf);
+		seq->fd = DatumGetInt32(DirectFunctionCall2(be_lo_open, PG_GETARG_DATUM(0), Int32GetDatum(INV_READ)));
+		seq->eof = false;
+		funcctx->user_fctx = seq;
 
-				cbor_send_type_and_uint64_value(buf, type, len);
-				pq_sendbytes(buf, CBORENTRY_GETSTR(entry, nr, cnt), len);
-				break;
-			}
-		case CBORENTRY_TYPE_ARRAY:
-			{
-				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+		MemoryContextSwitchTo(oldcontext);
+	}
 
-				cbor_send_type_and_uint64_value(buf, type, value->count);
-				for (i = 0; i < value->count; ++i)
-					cbor_send_helper(buf, value->entries, i, value->count);
-				break;
-			}
-		case CBORENTRY_TYPE_MAP:
-			{
-				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
-				int32		count2 = value->count * 2;
+	return cbor_sequence_next(fcinfo);
+}
 
-				cbor_send_type_and_uint64_value(buf, type, value->count);
-				for (i = 0; i < count2; ++i)
-					cbor_send_helper(buf, value->entries, i, count2);
-				break;
-			}
-		case CBORENTRY_TYPE_TAG:
-			{
-				CborTag    *value = CBORENTRY_VALUE(entry, nr, cnt);
+static Datum
+cbor_sequence_next(FunctionCallInfo fcinfo)
+{
+	FuncCallContext *funcctx = SRF_PERCALL_SETUP();
+	CborSequence *seq = funcctx->user_fctx;
 
-				cbor_send_type_and_uint64_value(buf, type, value->value);
-				cbor_send_helper(buf, &value->entry, 0, 1);
-				break;
-			}
-		case CBORENTRY_TYPE_FLOATORSIMPLE:
-			{
-				uint64	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+	while (!seq->eof && !cbor_core_complete((const uint8 *) seq->buf.data + seq->buf.cursor, seq->buf.len - seq->buf.cursor))
+		cbor_sequence_read(seq, funcctx->multi_call_memory_ctx);
 
-				if ((*value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
-				{
-					cbor_send_type_and_uint64_value(buf, type, *value & 0xFF);
-				}
-				else
-				{
-#define DBL_BASE_EXPONENT 1023
-#define DBL_EXPONENT(exp) (((uint64)(DBL_BASE_EXPONENT + (exp))) << 52)
+	if (seq->buf.cursor >= seq->buf.len)
+	{
+		if (seq->fd >= 0)
+			DirectFunctionCall1(be_lo_close, Int32GetDatum(seq->fd));
+		SRF_RETURN_DONE(funcctx);
+	}
 
-					uint64		sign = *value & 0x8000000000000000;
-					uint64		exponent = *value & 0x7FF0000000000000;
-					uint64		fraction = *value & 0x000FFFFFFFFFFFFF;
-					bool		is_max_exponent = exponent == DBL_EXPONENT(1024);
+	SRF_RETURN_NEXT(funcctx, cbor_decoder(&seq->buf));
+}
 
-					if (!exponent && !fraction)
-					{
-							pq_sendbyte(buf, type | CborAdditionalBytes2);
-							pq_sendint(buf, sign >> 48, 2);
-					}
-					else if (fraction & 0x000000001FFFFFFF || (!is_max_exponent && (exponent < DBL_EXPONENT(-126) || DBL_EXPONENT(127) < exponent)))
-					{
-						pq_sendbyte(buf, type | CborAdditionalBytes8);
-						pq_sendint64(buf, *value);
-					}
-					else if (fraction & 0x000003FFFFFFFFFF || (!is_max_exponent && (exponent < DBL_EXPONENT(-14) || DBL_EXPONENT(15) < exponent)))
-					{
-						uint32		single;
-
-						if (is_max_exponent)
-							exponent = 0xFF << 23;
-						else
-							exponent = (exponent - DBL_EXPONENT(-127)) >> 29;
-						single = (sign >> 32) | exponent | (fraction >> 29);
-						pq_sendbyte(buf, type | CborAdditionalBytes4);
-						pq_sendint(buf, single, 4);
-					}
-					else
-					{
-						uint32		half;
-
-						if (is_max_exponent)
-							exponent = 0x1F << 10;
-						else
-							exponent = (exponent - DBL_EXPONENT(-15)) >> 42;
-						half = (sign >> 48) | exponent | (fraction >> 42);
-						pq_sendbyte(buf, type | CborAdditionalBytes2);
-						pq_sendint(buf, half, 2);
-					}
-				}
-				break;
-			}
+/*
+ * Append the next chunk of the large object to the unread rest of buf.
+ */
+static void
+cbor_sequence_read(CborSequence * seq, MemoryContext context)
+{
+	MemoryContext oldcontext = MemoryContextSwitchTo(context);
+	int			nbytes;
+
+	if (seq->buf.cursor > 0)
+	{
+		seq->buf.len -= seq->buf.cursor;
+		memmove(seq->buf.data, seq->buf.data + seq->buf.cursor, seq->buf.len);
+		seq->buf.cursor = 0;
 	}
+
+	enlargeStringInfo(&seq->buf, CBOR_SEQUENCE_CHUNK);
+	nbytes = lo_read(seq->fd, seq->buf.data + seq->buf.len, CBOR_SEQUENCE_CHUNK);
+	seq->buf.len += nbytes;
+	seq->eof = (nbytes == 0);
+
+	MemoryContextSwitchTo(oldcontext);
 }
 
 PG_FUNCTION_INFO_V1(cbor_encode);
 Datum
 cbor_encode(PG_FUNCTION_ARGS)
+{
+	return cbor_encode_helper(fcinfo, false);
+}
+
+/*
+ * Encode the value with the pairs of maps ordered bytewise by their encoded
+ * keys, so equal values give identical bytes.
+ */
+PG_FUNCTION_INFO_V1(cbor_encode_canonical);
+Datum
+cbor_encode_canonical(PG_FUNCTION_ARGS)
+{
+	return cbor_encode_helper(fcinfo, true);
+}
+
+/*
+ * Reorder the pairs of all maps of a value like cbor_encode_canonical
+ * writes them, by decoding its canonical encoding.  Maps which only differ
+ * in the order of their pairs are then equal for comparisons, cbor_encode
+ * and the text output.
+ */
+PG_FUNCTION_INFO_V1(cbor_canonicalize);
+Datum
+cbor_canonicalize(PG_FUNCTION_ARGS)
 {
 	Cbor	   *cbor = PG_GETARG_CBOR(0);
-	StringInfoData buf;
+	CborEntry	type = cbor->root & CBORENTRY_TYPEMASK;
+	Size		size;
+	char	   *buf;
+	Cbor	   *result;
 
-	pq_begintypsend(&buf);
+	if (type != CBORENTRY_TYPE_ARRAY && type != CBORENTRY_TYPE_MAP && type != CBORENTRY_TYPE_TAG)
+		PG_RETURN_CBOR(cbor);
 
-	cbor_send_helper(&buf, &cbor->root, 0, 1);
+	size = cbor_core_encoded_size(&cbor->root, 0, 1);
+	buf = palloc(size);
+	cbor_core_encode_canonical(buf, &cbor->root, 0, 1);
+
+	cbor_core_stats = NULL;
+	result = cbor_core_decode((const uint8 *) buf, size, NULL);
+
+	pfree(buf);
+	PG_RETURN_CBOR(result);
+}
+
+static Datum
+cbor_encode_helper(FunctionCallInfo fcinfo, bool canonical)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	instr_time	start;
+	Size		size;
+	bytea	   *result;
+	char	   *end;
+
+	if (cbor_track_stats)
+		INSTR_TIME_SET_CURRENT(start);
+
+	size = cbor_core_encoded_size(&cbor->root, 0, 1);
+	result = (bytea *) palloc(VARHDRSZ + size);
+	SET_VARSIZE(result, VARHDRSZ + size);
+	if (canonical)
+		end = cbor_core_encode_canonical(VARDATA(result), &cbor->root, 0, 1);
+	else
+		end = cbor_core_encode(VARDATA(result), &cbor->root, 0, 1);
+	Assert(end == VARDATA(result) + size);
+	(void) end;
+
+	if (cbor_track_stats)
+		cbor_stats_add(&cbor_counters.encode, size, &start);
 
 	PG_FREE_IF_COPY(cbor, 0);
-	PG_RETURN_BYTEA_P(pq_endtypsend(&buf));
+	PG_RETURN_BYTEA_P(result);
 }
 
+static const char cbor_hex_digits[] = "0123456789abcdef";
+
+/*
+ * The character following the backslash for characters which need to be
+ * escaped in text strings, zero for all others.
+ */
+static const char cbor_escape_chars[256] = {
+	['\b'] = 'b',
+	['\f'] = 'f',
+	['\n'] = 'n',
+	['\r'] = 'r',
+	['\t'] = 't',
+	['\\'] = '\\',
+	['"'] = '"'
+};
+
 void
 cbor_out_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt)
 {
@@ -470,66 +358,63 @@ cbor_out_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt)
 	{
 		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
 			{
-				uint64_t	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
 
-				appendStringInfo(buf, "%" PRIu64, *value);
+				appendStringInfo(buf, "%" PRIu64, value);
 				break;
 			}
 		case CBORENTRY_TYPE_NEGATIVEINTEGER:
 			{
-				uint64_t	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
 
-				if (~(*value ^ 0))
-					appendStringInfo(buf, "-%" PRIu64, *value + 1);
+				if (~(value ^ 0))
+					appendStringInfo(buf, "-%" PRIu64, value + 1);
 				else
 					appendStringInfo(buf, "-18446744073709551616");
 				break;
 			}
 		case CBORENTRY_TYPE_BYTESTRING:
 			{
-				appendStringInfoChar(buf, 'h');
-				appendStringInfoChar(buf, '\'');
-				for (i = 0; i < CBORENTRY_STRLEN(entry, nr, cnt); ++i)
-					appendStringInfo(buf, "%02x", ((uint8 *) CBORENTRY_GETSTR(entry, nr, cnt))[i]);
-				appendStringInfoChar(buf, '\'');
+				uint8	   *ch = (uint8 *) CBORENTRY_GETSTR(entry, nr, cnt);
+				int32		len = CBORENTRY_STRLEN(entry, nr, cnt);
+				char	   *out;
+
+				enlargeStringInfo(buf, len * 2 + 3);
+				out = buf->data + buf->len;
+				*out++ = 'h';
+				*out++ = '\'';
+				for (i = 0; i < len; ++i)
+				{
+					out[0] = cbor_hex_digits[ch[i] >> 4];
+					out[1] = cbor_hex_digits[ch[i] & 0xF];
+					out += 2;
+				}
+				*out++ = '\'';
+				*out = '\0';
+				buf->len = out - buf->data;
 				break;
 			}
 		case CBORENTRY_TYPE_TEXTSTRING:
 			{
 				char	   *ch = CBORENTRY_GETSTR(entry, nr, cnt);
 				int32		len = CBORENTRY_STRLEN(entry, nr, cnt);
+				int32		start = 0;
 
 				enlargeStringInfo(buf, len + 2);
 				appendStringInfoChar(buf, '"');
 				for (i = 0; i < len; ++i)
 				{
-					switch (ch[i])
-					{
-						case '\b':
-							appendStringInfoString(buf, "\\b");
-							break;
-						case '\f':
-							appendStringInfoString(buf, "\\f");
-							break;
-						case '\n':
-							appendStringInfoString(buf, "\\n");
-							break;
-						case '\r':
-							appendStringInfoString(buf, "\\r");
-							break;
-						case '\t':
-							appendStringInfoString(buf, "\\t");
-							break;
-						case '\\':
-							appendStringInfoString(buf, "\\\\");
-							break;
-						case '\"':
-							appendStringInfoString(buf, "\\\"");
-							break;
-						default:
-							appendStringInfoChar(buf, ch[i]);
-					}
+					char		escape = cbor_escape_chars[(uint8) ch[i]];
+
+					if (!escape)
+						continue;
+
+					appendBinaryStringInfo(buf, ch + start, i - start);
+					appendStringInfoChar(buf, '\\');
+					appendStringInfoChar(buf, escape);
+					start = i + 1;
 				}
+				appendBinaryStringInfo(buf, ch + start, len - start);
 
 				appendStringInfoChar(buf, '"');
 				break;
@@ -551,15 +436,19 @@ cbor_out_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt)
 		case CBORENTRY_TYPE_MAP:
 			{
 				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count = CBORCONTAINER_COUNT(value);
+				uint32	   *order = CBORCONTAINER_IS_SORTED(value) ? CBORCONTAINER_ORDER(value) : NULL;
 
 				appendStringInfoChar(buf, '{');
-				for (i = 0; i < value->count; ++i)
+				for (i = 0; i < count; ++i)
 				{
+					int32		pair = order ? order[i] : i;
+
 					if (i)
 						appendStringInfoString(buf, ", ");
-					cbor_out_helper(buf, value->entries, i * 2 + 0, value->count * 2);
+					cbor_out_helper(buf, value->entries, pair * 2 + 0, count * 2);
 					appendStringInfoString(buf, ": ");
-					cbor_out_helper(buf, value->entries, i * 2 + 1, value->count * 2);
+					cbor_out_helper(buf, value->entries, pair * 2 + 1, count * 2);
 				}
 				appendStringInfoChar(buf, '}');
 				break;
@@ -576,11 +465,11 @@ cbor_out_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt)
 			}
 		case CBORENTRY_TYPE_FLOATORSIMPLE:
 			{
-				uint64	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
 
-				if ((*value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
 				{
-					uint8		simple = *value & 0xFF;
+					uint8		simple = value & 0xFF;
 
 					switch (simple)
 					{
@@ -602,7 +491,7 @@ cbor_out_helper(StringInfo buf, CborEntry * entry, int32 nr, int32 cnt)
 				}
 				else
 				{
-					double		flt = *((double *) value);
+					double		flt = *((double *) &value);
 
 					if (isfinite(flt))
 					{
@@ -635,11 +524,84 @@ Datum
 cbor_out(PG_FUNCTION_ARGS)
 {
 	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	instr_time	start;
 	StringInfoData buf;
 
+	if (cbor_track_stats)
+		INSTR_TIME_SET_CURRENT(start);
+
 	initStringInfo(&buf);
 	cbor_out_helper(&buf, &cbor->root, 0, 1);
 
+	if (cbor_track_stats)
+		cbor_stats_add(&cbor_counters.output, buf.len, &start);
+
 	PG_FREE_IF_COPY(cbor, 0);
 	PG_RETURN_CSTRING(buf.data);
 }
+
+/*
+ * cbor_raw stores the encoded data item verbatim, so sending it is a plain
+ * copy and receiving it only needs the validation pass of the decoder.  It
+ * is decoded into a cbor by the implicit cast when an operator needs random
+ * access to its contents.
+ */
+PG_FUNCTION_INFO_V1(cbor_raw_to_cbor);
+Datum
+cbor_raw_to_cbor(PG_FUNCTION_ARGS)
+{
+	bytea	   *data = PG_GETARG_BYTEA_PP(0);
+	StringInfoData inbuf;
+
+	inbuf.maxlen = inbuf.len = VARSIZE_ANY_EXHDR(data);
+	inbuf.data = VARDATA_ANY(data);
+	inbuf.cursor = 0;
+
+	return cbor_decoder(&inbuf);
+}
+
+PG_FUNCTION_INFO_V1(cbor_raw_in);
+Datum
+cbor_raw_in(PG_FUNCTION_ARGS)
+{
+	Datum		cbor = DirectFunctionCall1(cbor_in, PG_GETARG_DATUM(0));
+
+	return DirectFunctionCall1(cbor_encode, cbor);
+}
+
+PG_FUNCTION_INFO_V1(cbor_raw_out);
+Datum
+cbor_raw_out(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = DatumGetCbor(DirectFunctionCall1(cbor_raw_to_cbor, PG_GETARG_DATUM(0)));
+	StringInfoData buf;
+
+	initStringInfo(&buf);
+	cbor_out_helper(&buf, &cbor->root, 0, 1);
+
+	pfree(cbor);
+	PG_RETURN_CSTRING(buf.data);
+}
+
+PG_FUNCTION_INFO_V1(cbor_raw_recv);
+Datum
+cbor_raw_recv(PG_FUNCTION_ARGS)
+{
+	StringInfo	inbuf = (StringInfo) PG_GETARG_POINTER(0);
+	Size		len = cbor_core_scan((const uint8 *) inbuf->data + inbuf->cursor, inbuf->len - inbuf->cursor);
+	bytea	   *result;
+
+	result = palloc(VARHDRSZ + len);
+	SET_VARSIZE(result, VARHDRSZ + len);
+	memcpy(VARDATA(result), inbuf->data + inbuf->cursor, len);
+	inbuf->cursor += len;
+
+	PG_RETURN_BYTEA_P(result);
+}
+
+PG_FUNCTION_INFO_V1(cbor_raw_send);
+Datum
+cbor_raw_send(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BYTEA_P(PG_GETARG_BYTEA_P(0));
+}
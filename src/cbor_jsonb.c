@@ -0,0 +1,452 @@
+#include "cbor.h"
+#include <math.h>
+
+#include "miscadmin.h"
+#include "utils/builtins.h"
+#include "utils/jsonb.h"
+
+#if PG_VERSION_NUM < 110000
+#define PG_GETARG_JSONB_P(x) PG_GETARG_JSONB(x)
+#define PG_RETURN_JSONB_P(x) PG_RETURN_JSONB(x)
+#endif
+
+/*
+ * The tags 21, 22 and 23 of RFC 7049 section 2.4.4.2 ask for the byte
+ * strings they enclose to be converted to base64url, base64 and hex.
+ */
+#define CBOR_TAG_EXPECT_BASE64URL 21
+#define CBOR_TAG_EXPECT_HEX 23
+
+int			cbor_jsonb_bytes = CBOR_JSONB_BYTES_BASE64URL;
+int			cbor_jsonb_tags = CBOR_JSONB_TAGS_VALUE;
+
+static JsonbValue *cbor_push_jsonb(JsonbParseState **state, JsonbIteratorToken token, CborEntry * entry, int32 nr, int32 cnt, int bytes);
+static bool cbor_jsonb_scalar(JsonbValue *v, CborEntry * entry, int32 nr, int32 cnt, int bytes);
+static void cbor_jsonb_string(JsonbValue *v, const char *str, int len);
+static void cbor_jsonb_text(JsonbValue *v, CborEntry * entry, int32 nr, int32 cnt);
+static Numeric cbor_jsonb_numeric(uint64 value, bool negative);
+static int	cbor_jsonb_tag_bytes(uint64 tag, int bytes);
+static char *cbor_encode_bytes(const uint8 *data, int32 len, int bytes, int *outlen);
+static CborEntry cbor_write_jsonb(StringInfo buf, JsonbIterator **it, JsonbIteratorToken token, JsonbValue *v);
+
+
+/*
+ * Convert cbor to jsonb directly from entries to JsonbValues.  Map keys
+ * which are not text strings become their text representation, floats
+ * without a numeric counterpart, byte strings and unusual simple values
+ * become strings.
+ */
+PG_FUNCTION_INFO_V1(cbor_to_jsonb);
+Datum
+cbor_to_jsonb(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	CborEntry  *entry = &cbor->root;
+	int			bytes = cbor_jsonb_bytes;
+	JsonbParseState *state = NULL;
+	JsonbValue	v;
+	JsonbValue *result;
+
+	/* a scalar root is converted on its own, so drop its tags here */
+	while ((*entry & CBORENTRY_TYPEMASK) == CBORENTRY_TYPE_TAG && cbor_jsonb_tags == CBOR_JSONB_TAGS_VALUE)
+	{
+		CborTag    *tag = CBORENTRY_VALUE(entry, 0, 1);
+
+		bytes = cbor_jsonb_tag_bytes(tag->value, bytes);
+		entry = &tag->entry;
+	}
+
+	if (cbor_jsonb_scalar(&v, entry, 0, 1, bytes))
+		result = &v;
+	else
+		result = cbor_push_jsonb(&state, WJB_ELEM, entry, 0, 1, bytes);
+
+	PG_RETURN_JSONB_P(JsonbValueToJsonb(result));
+}
+
+/*
+ * Convert jsonb to cbor by writing the containers of the jsonb iterator
+ * in place, which provides their number of items up front.
+ */
+PG_FUNCTION_INFO_V1(jsonb_to_cbor);
+Datum
+jsonb_to_cbor(PG_FUNCTION_ARGS)
+{
+	Jsonb	   *jsonb = PG_GETARG_JSONB_P(0);
+	JsonbIterator *it = JsonbIteratorInit(&jsonb->root);
+	JsonbIteratorToken token;
+	JsonbValue	v;
+	StringInfoData buf;
+	Size		header = offsetof(Cbor, root) + sizeof(CborEntry);
+	CborEntry	type;
+	Cbor	   *result;
+
+	initStringInfo(&buf);
+	buf.len = header;
+
+	token = JsonbIteratorNext(&it, &v, false);
+	if (token == WJB_BEGIN_ARRAY && v.val.array.rawScalar)
+		token = JsonbIteratorNext(&it, &v, false);
+	type = cbor_write_jsonb(&buf, &it, token, &v);
+	cbor_check_size(buf.len - header);
+
+	result = (Cbor *) buf.data;
+	SET_VARSIZE(result, buf.len);
+	result->root = type | (buf.len - header);
+
+	PG_RETURN_CBOR(result);
+}
+
+
+static JsonbValue *
+cbor_push_jsonb(JsonbParseState **state, JsonbIteratorToken token, CborEntry * entry, int32 nr, int32 cnt, int bytes)
+{
+	JsonbValue	v;
+	int32		i;
+
+	check_stack_depth();
+
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+
+				pushJsonbValue(state, WJB_BEGIN_ARRAY, NULL);
+				for (i = 0; i < value->count; ++i)
+					cbor_push_jsonb(state, WJB_ELEM, value->entries, i, value->count, bytes);
+				return pushJsonbValue(state, WJB_END_ARRAY, NULL);
+			}
+
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count = CBORCONTAINER_COUNT(value);
+				uint32	   *order = CBORCONTAINER_IS_SORTED(value) ? CBORCONTAINER_ORDER(value) : NULL;
+
+				pushJsonbValue(state, WJB_BEGIN_OBJECT, NULL);
+				for (i = 0; i < count; ++i)
+				{
+					int32		pair = order ? order[i] : i;
+					CborEntry  *key = value->entries;
+
+					if ((key[pair * 2] & CBORENTRY_TYPEMASK) == CBORENTRY_TYPE_TEXTSTRING)
+						cbor_jsonb_text(&v, key, pair * 2, count * 2);
+					else
+					{
+						StringInfoData buf;
+
+						initStringInfo(&buf);
+						cbor_out_helper(&buf, key, pair * 2, count * 2);
+						cbor_jsonb_string(&v, buf.data, buf.len);
+					}
+
+					pushJsonbValue(state, WJB_KEY, &v);
+					cbor_push_jsonb(state, WJB_VALUE, value->entries, pair * 2 + 1, count * 2, bytes);
+				}
+				return pushJsonbValue(state, WJB_END_OBJECT, NULL);
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *tag = CBORENTRY_VALUE(entry, nr, cnt);
+
+				switch (cbor_jsonb_tags)
+				{
+					case CBOR_JSONB_TAGS_VALUE:
+						return cbor_push_jsonb(state, token, &tag->entry, 0, 1, cbor_jsonb_tag_bytes(tag->value, bytes));
+
+					case CBOR_JSONB_TAGS_OBJECT:
+						pushJsonbValue(state, WJB_BEGIN_OBJECT, NULL);
+						cbor_jsonb_string(&v, "tag", 3);
+						pushJsonbValue(state, WJB_KEY, &v);
+						v.type = jbvNumeric;
+						v.val.numeric = cbor_jsonb_numeric(tag->value, false);
+						pushJsonbValue(state, WJB_VALUE, &v);
+						cbor_jsonb_string(&v, "value", 5);
+						pushJsonbValue(state, WJB_KEY, &v);
+						cbor_push_jsonb(state, WJB_VALUE, &tag->entry, 0, 1, bytes);
+						return pushJsonbValue(state, WJB_END_OBJECT, NULL);
+
+					default:
+						ereport(ERROR,
+								(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+								 errmsg("cannot convert cbor tag " UINT64_FORMAT " to jsonb", tag->value),
+								 errhint("Set cbor.jsonb_tags to \"value\" or \"object\" to convert tags.")));
+				}
+			}
+	}
+
+	cbor_jsonb_scalar(&v, entry, nr, cnt, bytes);
+	return pushJsonbValue(state, token, &v);
+}
+
+/*
+ * Convert a scalar entry to a JsonbValue and return false for arrays, maps
+ * and tags.
+ */
+static bool
+cbor_jsonb_scalar(JsonbValue *v, CborEntry * entry, int32 nr, int32 cnt, int bytes)
+{
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
+		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+			v->type = jbvNumeric;
+			v->val.numeric = cbor_jsonb_numeric(cbor_get_scalar(entry, nr, cnt), (entry[nr] & CBORENTRY_TYPEMASK) == CBORENTRY_TYPE_NEGATIVEINTEGER);
+			return true;
+
+		case CBORENTRY_TYPE_BYTESTRING:
+			{
+				int			len;
+				char	   *str = cbor_encode_bytes((uint8 *) CBORENTRY_GETSTR(entry, nr, cnt), CBORENTRY_STRLEN(entry, nr, cnt), bytes, &len);
+
+				cbor_jsonb_string(v, str, len);
+				return true;
+			}
+
+		case CBORENTRY_TYPE_TEXTSTRING:
+			cbor_jsonb_text(v, entry, nr, cnt);
+			return true;
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			{
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
+				double		dbl;
+
+				if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+				{
+					switch (value & 0xFF)
+					{
+						case CBOR_SIMPLE_FALSE:
+						case CBOR_SIMPLE_TRUE:
+							v->type = jbvBool;
+							v->val.boolean = (value & 0xFF) == CBOR_SIMPLE_TRUE;
+							return true;
+
+						case CBOR_SIMPLE_NULL:
+						case CBOR_SIMPLE_UNDEFINED:
+							v->type = jbvNull;
+							return true;
+					}
+				}
+				else
+				{
+					memcpy(&dbl, &value, sizeof(dbl));
+					if (!isnan(dbl) && !isinf(dbl))
+					{
+						v->type = jbvNumeric;
+						v->val.numeric = DatumGetNumeric(DirectFunctionCall1(float8_numeric, Float8GetDatum(dbl)));
+						return true;
+					}
+				}
+
+				{
+					StringInfoData buf;
+
+					initStringInfo(&buf);
+					cbor_out_helper(&buf, entry, nr, cnt);
+					cbor_jsonb_string(v, buf.data, buf.len);
+					return true;
+				}
+			}
+	}
+
+	return false;
+}
+
+static void
+cbor_jsonb_string(JsonbValue *v, const char *str, int len)
+{
+	v->type = jbvString;
+	v->val.string.val = (char *) str;
+	v->val.string.len = len;
+}
+
+/*
+ * Text strings are checked and converted into the server encoding the way
+ * jsonb input treats its strings.
+ */
+static void
+cbor_jsonb_text(JsonbValue *v, CborEntry * entry, int32 nr, int32 cnt)
+{
+	int			len = CBORENTRY_STRLEN(entry, nr, cnt);
+	const char *str = cbor_string_to_server(CBORENTRY_GETSTR(entry, nr, cnt), &len);
+
+	cbor_jsonb_string(v, str, len);
+}
+
+/*
+ * Return the numeric of an unsigned integer or, with negative, of the
+ * negative integer -1 - value.
+ */
+static Numeric
+cbor_jsonb_numeric(uint64 value, bool negative)
+{
+	char		str[32];
+
+	if (value <= PG_INT64_MAX)
+		return DatumGetNumeric(DirectFunctionCall1(int8_numeric, Int64GetDatum(negative ? -1 - (int64) value : (int64) value)));
+
+	if (!negative)
+		snprintf(str, sizeof(str), UINT64_FORMAT, value);
+	else if (value != ~(uint64) 0)
+		snprintf(str, sizeof(str), "-" UINT64_FORMAT, value + 1);
+	else
+		strcpy(str, "-18446744073709551616");
+
+	return DatumGetNumeric(DirectFunctionCall3(numeric_in, CStringGetDatum(str), ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+}
+
+/*
+ * Return the encoding of byte strings enclosed in tag.
+ */
+static int
+cbor_jsonb_tag_bytes(uint64 tag, int bytes)
+{
+	if (tag >= CBOR_TAG_EXPECT_BASE64URL && tag <= CBOR_TAG_EXPECT_HEX)
+		return CBOR_JSONB_BYTES_BASE64URL + (int) (tag - CBOR_TAG_EXPECT_BASE64URL);
+	return bytes;
+}
+
+static const char cbor_base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char cbor_base64url_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+/*
+ * Encode a byte string for jsonb.  base64url is written without padding as
+ * recommended by RFC 7049 section 4.1.
+ */
+static char *
+cbor_encode_bytes(const uint8 *data, int32 len, int bytes, int *outlen)
+{
+	const char *chars = bytes == CBOR_JSONB_BYTES_BASE64URL ? cbor_base64url_chars : cbor_base64_chars;
+	char	   *result;
+	char	   *out;
+	int32		i;
+
+	if (bytes == CBOR_JSONB_BYTES_HEX)
+	{
+		result = palloc(len * 2 + 1);
+		*outlen = hex_encode((const char *) data, len, result);
+		return result;
+	}
+
+	result = out = palloc((len + 2) / 3 * 4 + 1);
+	for (i = 0; i + 2 < len; i += 3)
+	{
+		uint32		bits = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+
+		*out++ = chars[bits >> 18];
+		*out++ = chars[(bits >> 12) & 0x3F];
+		*out++ = chars[(bits >> 6) & 0x3F];
+		*out++ = chars[bits & 0x3F];
+	}
+
+	if (i < len)
+	{
+		uint32		bits = data[i] << 16;
+
+		if (i + 1 < len)
+			bits |= data[i + 1] << 8;
+
+		*out++ = chars[bits >> 18];
+		*out++ = chars[(bits >> 12) & 0x3F];
+		if (i + 1 < len)
+			*out++ = chars[(bits >> 6) & 0x3F];
+		if (bytes == CBOR_JSONB_BYTES_BASE64)
+		{
+			if (i + 1 >= len)
+				*out++ = '=';
+			*out++ = '=';
+		}
+	}
+
+	*outlen = out - result;
+	return result;
+}
+
+/*
+ * Append the value of the jsonb item the iterator returned as token to buf
+ * and return its type.  Numbers become integers when they are integral and
+ * fit in 64 bits and floats otherwise.
+ */
+static CborEntry
+cbor_write_jsonb(StringInfo buf, JsonbIterator **it, JsonbIteratorToken token, JsonbValue *v)
+{
+	check_stack_depth();
+
+	if (token == WJB_BEGIN_ARRAY || token == WJB_BEGIN_OBJECT)
+	{
+		CborEntry	type = token == WJB_BEGIN_ARRAY ? CBORENTRY_TYPE_ARRAY : CBORENTRY_TYPE_MAP;
+		int32		count = token == WJB_BEGIN_ARRAY ? v->val.array.nElems : v->val.object.nPairs;
+		int32		cnt = token == WJB_BEGIN_ARRAY ? count : count * 2;
+		Size		start = buf->len;
+		Size		values;
+		CborContainer *container;
+		int32		i;
+
+		enlargeStringInfo(buf, offsetof(CborContainer, entries) + cnt * sizeof(CborEntry));
+		buf->len += offsetof(CborContainer, entries) + cnt * sizeof(CborEntry);
+		values = buf->len;
+
+		for (i = 0; i < cnt; ++i)
+		{
+			CborEntry	entry = cbor_write_jsonb(buf, it, JsonbIteratorNext(it, v, false), v);
+
+			cbor_check_size(buf->len - start);
+			container = (CborContainer *) (buf->data + start);
+			container->entries[i] = entry | (buf->len - values);
+		}
+
+		/* the matching end token */
+		JsonbIteratorNext(it, v, false);
+
+		enlargeStringInfo(buf, CBORCONTAINER_SORTSIZE(count));
+		container = (CborContainer *) (buf->data + start);
+		container->count = count;
+		if (type == CBORENTRY_TYPE_MAP)
+			buf->len += cbor_sort_map(container);
+
+		return type;
+	}
+
+	switch (v->type)
+	{
+		case jbvNull:
+			enlargeStringInfo(buf, sizeof(uint64));
+			buf->len += cbor_put_scalar(buf->data + buf->len, CBORENTRY_TYPE_FLOATORSIMPLE, CBOR_SIMPLE_VALUE | CBOR_SIMPLE_NULL);
+			return CBORENTRY_TYPE_FLOATORSIMPLE;
+
+		case jbvBool:
+			enlargeStringInfo(buf, sizeof(uint64));
+			buf->len += cbor_put_scalar(buf->data + buf->len, CBORENTRY_TYPE_FLOATORSIMPLE, CBOR_SIMPLE_VALUE | (v->val.boolean ? CBOR_SIMPLE_TRUE : CBOR_SIMPLE_FALSE));
+			return CBORENTRY_TYPE_FLOATORSIMPLE;
+
+		case jbvString:
+			{
+				Size		size = INTALIGN(VARHDRSZ + v->val.string.len);
+
+				enlargeStringInfo(buf, size);
+				memset(buf->data + buf->len, 0, size);
+				SET_VARSIZE(buf->data + buf->len, VARHDRSZ + v->val.string.len);
+				memcpy(buf->data + buf->len + VARHDRSZ, v->val.string.val, v->val.string.len);
+				buf->len += size;
+				return CBORENTRY_TYPE_TEXTSTRING;
+			}
+
+		case jbvNumeric:
+			{
+				Cbor	   *num = cbor_make_numeric(v->val.numeric);
+				CborEntry	type = num->root & CBORENTRY_TYPEMASK;
+
+				appendBinaryStringInfo(buf, (char *) (&num->root + 1), CBORENTRY_ENDPOS(&num->root, 0));
+				pfree(num);
+				return type;
+			}
+
+		default:
+			elog(ERROR, "unexpected jsonb value type %d", v->type);
+	}
+
+	return 0;
+}
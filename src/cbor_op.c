@@ -1,322 +1,1158 @@
 #include "cbor.h"
+#include <math.h>
+
 #include "access/hash.h"
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
+#include "catalog/pg_type.h"
+#include "miscadmin.h"
+#include "mb/pg_wchar.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/sortsupport.h"
+
+/*
+ * Values stored out of line are fetched as a slice of their first bytes,
+ * which often suffices to compare them or to find a map value, and are only
+ * fetched further when an operation needs bytes beyond it.
+ */
+#define CBOR_PREFIX_SIZE 2048
+
+typedef struct CborPrefix
+{
+	Datum		datum;
+	Cbor	   *cbor;			/* the fetched bytes, including the header */
+	Size		avail;			/* number of fetched bytes */
+	Size		size;			/* size of the complete value */
+	Size		need;			/* bytes needed by the last operation, or 0 */
+}	CborPrefix;
+
+#if PG_VERSION_NUM >= 90500
+#include "lib/hyperloglog.h"
+
+typedef struct CborSortSupport
+{
+	int64		input_count;
+	hyperLogLogState abbr_card;
+}	CborSortSupport;
+#endif
 
 static int	compareCbor(Cbor * a, Cbor * b);
-static int	lengthCompareCborText(const struct varlena * a, const struct varlena * b);
-static int	cbor_cmp_recursive(CborEntry * a, CborEntry * b, int32 nr, int32 cnt);
-static uint32 cbor_hash_recursive(uint32 hash, CborEntry * cbor, int32 nr, int32 cnt);
+static int	compareCborDatum(Datum x, Datum y);
+static void cbor_prefix_init(CborPrefix * prefix, Datum datum, Size size);
+static void cbor_prefix_fetch(CborPrefix * prefix, Size size);
+static bool cbor_prefix_retry(CborPrefix * prefix);
+static void cbor_prefix_free(CborPrefix * prefix);
+static bool cbor_prefix_has(CborPrefix * prefix, const void *ptr, Size len);
+static bool cbor_prefix_has_entry(CborPrefix * prefix, CborEntry * entry, int32 nr, int32 cnt);
+static int	cbor_cmp_prefix(CborPrefix * a, CborPrefix * b);
+static int	cbor_cmp_fast(Datum x, Datum y, SortSupport ssup);
+#if PG_VERSION_NUM >= 90500
+static int	cbor_cmp_abbrev(Datum x, Datum y, SortSupport ssup);
+static Datum cbor_abbrev_convert(Datum original, SortSupport ssup);
+static bool cbor_abbrev_abort(int memtupcount, SortSupport ssup);
+#endif
+static uint64 cbor_abbrev_entry(CborPrefix * prefix, CborEntry * entry, int32 nr, int32 cnt);
+static int	cbor_cmp_probe(CborPrefix * prefix, CborEntry * entry, int32 nr, int32 cnt, CborEntry type, const char *str, int32 len, uint64 uint);
+static int32 cbor_map_lookup(CborPrefix * prefix, CborContainer * value, CborEntry type, const char *str, int32 len, uint64 uint);
+static bool cbor_contains_recursive(CborEntry * a, int32 nrA, int32 cntA, CborEntry * b, int32 nrB, int32 cntB);
+static bool cbor_contains_pair(CborContainer * a, CborEntry * b, int32 nrB, int32 cntB);
+static bool cbor_find_key(CborPrefix * prefix, CborEntry ** entry, int32 * nr, int32 * cnt, const char *key, int32 keylen);
+static bool cbor_find_index(CborPrefix * prefix, CborEntry ** entry, int32 * nr, int32 * cnt, int32 index);
+static bool cbor_find_path(CborPrefix * prefix, CborEntry ** entry, int32 * nr, int32 * cnt, ArrayType *path);
+static void *cbor_lookup(Datum datum, text *key, int32 index, ArrayType *path, bool as_text);
 
 
 PG_FUNCTION_INFO_V1(cbor_ne);
 Datum
 cbor_ne(PG_FUNCTION_ARGS)
 {
-	Cbor	   *a = PG_GETARG_CBOR(0);
-	Cbor	   *b = PG_GETARG_CBOR(1);
-	bool		res;
-
-	res = (compareCbor(a, b) != 0);
-
-	PG_FREE_IF_COPY(a, 0);
-	PG_FREE_IF_COPY(b, 1);
-	PG_RETURN_BOOL(res);
+	PG_RETURN_BOOL(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) != 0);
 }
 
 PG_FUNCTION_INFO_V1(cbor_lt);
 Datum
 cbor_lt(PG_FUNCTION_ARGS)
 {
-	Cbor	   *a = PG_GETARG_CBOR(0);
-	Cbor	   *b = PG_GETARG_CBOR(1);
-	bool		res;
-
-	res = (compareCbor(a, b) < 0);
-
-	PG_FREE_IF_COPY(a, 0);
-	PG_FREE_IF_COPY(b, 1);
-	PG_RETURN_BOOL(res);
+	PG_RETURN_BOOL(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) < 0);
 }
 
 PG_FUNCTION_INFO_V1(cbor_gt);
 Datum
 cbor_gt(PG_FUNCTION_ARGS)
 {
-	Cbor	   *a = PG_GETARG_CBOR(0);
-	Cbor	   *b = PG_GETARG_CBOR(1);
-	bool		res;
-
-	res = (compareCbor(a, b) > 0);
-
-	PG_FREE_IF_COPY(a, 0);
-	PG_FREE_IF_COPY(b, 1);
-	PG_RETURN_BOOL(res);
+	PG_RETURN_BOOL(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) > 0);
 }
 
 PG_FUNCTION_INFO_V1(cbor_le);
 Datum
 cbor_le(PG_FUNCTION_ARGS)
 {
-	Cbor	   *a = PG_GETARG_CBOR(0);
-	Cbor	   *b = PG_GETARG_CBOR(1);
-	bool		res;
-
-	res = (compareCbor(a, b) <= 0);
-
-	PG_FREE_IF_COPY(a, 0);
-	PG_FREE_IF_COPY(b, 1);
-	PG_RETURN_BOOL(res);
+	PG_RETURN_BOOL(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) <= 0);
 }
 
 PG_FUNCTION_INFO_V1(cbor_ge);
 Datum
 cbor_ge(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) >= 0);
+}
+
+PG_FUNCTION_INFO_V1(cbor_eq);
+Datum
+cbor_eq(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_BOOL(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)) == 0);
+}
+
+PG_FUNCTION_INFO_V1(cbor_cmp);
+Datum
+cbor_cmp(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_INT32(compareCborDatum(PG_GETARG_DATUM(0), PG_GETARG_DATUM(1)));
+}
+
+/*
+ * Sorts compare abbreviated keys, which are built from the type of the root
+ * and the start of its value, and fall back to cbor_cmp only for ties.
+ */
+PG_FUNCTION_INFO_V1(cbor_sortsupport);
+Datum
+cbor_sortsupport(PG_FUNCTION_ARGS)
+{
+	SortSupport ssup = (SortSupport) PG_GETARG_POINTER(0);
+
+	ssup->comparator = cbor_cmp_fast;
+
+#if PG_VERSION_NUM >= 90500
+	if (ssup->abbreviate)
+	{
+		CborSortSupport *sss;
+
+		sss = MemoryContextAlloc(ssup->ssup_cxt, sizeof(CborSortSupport));
+		sss->input_count = 0;
+		initHyperLogLog(&sss->abbr_card, 10);
+
+		ssup->ssup_extra = sss;
+		ssup->comparator = cbor_cmp_abbrev;
+		ssup->abbrev_converter = cbor_abbrev_convert;
+		ssup->abbrev_abort = cbor_abbrev_abort;
+		ssup->abbrev_full_comparator = cbor_cmp_fast;
+	}
+#endif
+
+	PG_RETURN_VOID();
+}
+
+
+PG_FUNCTION_INFO_V1(cbor_hash);
+Datum
+cbor_hash(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	uint32		hash;
+
+	hash = (uint32) cbor_hash_entry_extended(&cbor->root, 0, 1, 0);
+
+	PG_FREE_IF_COPY(cbor, 0);
+	PG_RETURN_INT32(hash);
+}
+
+PG_FUNCTION_INFO_V1(cbor_hash_extended);
+Datum
+cbor_hash_extended(PG_FUNCTION_ARGS)
+{
+	Cbor	   *cbor = PG_GETARG_CBOR(0);
+	uint64		seed = PG_GETARG_INT64(1);
+	uint64		hash;
+
+	hash = cbor_hash_entry_extended(&cbor->root, 0, 1, seed);
+
+	PG_FREE_IF_COPY(cbor, 0);
+	PG_RETURN_INT64(hash);
+}
+
+
+PG_FUNCTION_INFO_V1(cbor_contains);
+Datum
+cbor_contains(PG_FUNCTION_ARGS)
 {
 	Cbor	   *a = PG_GETARG_CBOR(0);
 	Cbor	   *b = PG_GETARG_CBOR(1);
 	bool		res;
 
-	res = (compareCbor(a, b) >= 0);
+	res = cbor_contains_recursive(&a->root, 0, 1, &b->root, 0, 1);
 
 	PG_FREE_IF_COPY(a, 0);
 	PG_FREE_IF_COPY(b, 1);
 	PG_RETURN_BOOL(res);
 }
 
-PG_FUNCTION_INFO_V1(cbor_eq);
+PG_FUNCTION_INFO_V1(cbor_contained);
 Datum
-cbor_eq(PG_FUNCTION_ARGS)
+cbor_contained(PG_FUNCTION_ARGS)
 {
 	Cbor	   *a = PG_GETARG_CBOR(0);
 	Cbor	   *b = PG_GETARG_CBOR(1);
 	bool		res;
 
-	res = (compareCbor(a, b) == 0);
+	res = cbor_contains_recursive(&b->root, 0, 1, &a->root, 0, 1);
 
 	PG_FREE_IF_COPY(a, 0);
 	PG_FREE_IF_COPY(b, 1);
 	PG_RETURN_BOOL(res);
 }
 
-PG_FUNCTION_INFO_V1(cbor_cmp);
+
+PG_FUNCTION_INFO_V1(cbor_object_field);
 Datum
-cbor_cmp(PG_FUNCTION_ARGS)
+cbor_object_field(PG_FUNCTION_ARGS)
 {
-	Cbor	   *a = PG_GETARG_CBOR(0);
-	Cbor	   *b = PG_GETARG_CBOR(1);
-	int			res;
+	Cbor	   *result = cbor_lookup(PG_GETARG_DATUM(0), PG_GETARG_TEXT_PP(1), 0, NULL, false);
 
-	res = compareCbor(a, b);
+	if (!result)
+		PG_RETURN_NULL();
 
-	PG_FREE_IF_COPY(a, 0);
-	PG_FREE_IF_COPY(b, 1);
-	PG_RETURN_INT32(res);
+	PG_RETURN_CBOR(result);
 }
 
+PG_FUNCTION_INFO_V1(cbor_object_field_text);
+Datum
+cbor_object_field_text(PG_FUNCTION_ARGS)
+{
+	text	   *result = cbor_lookup(PG_GETARG_DATUM(0), PG_GETARG_TEXT_PP(1), 0, NULL, true);
 
-PG_FUNCTION_INFO_V1(cbor_hash);
+	if (!result)
+		PG_RETURN_NULL();
+
+	PG_RETURN_TEXT_P(result);
+}
+
+PG_FUNCTION_INFO_V1(cbor_array_element);
 Datum
-cbor_hash(PG_FUNCTION_ARGS)
+cbor_array_element(PG_FUNCTION_ARGS)
 {
-	Cbor	   *cbor = PG_GETARG_CBOR(0);
-	uint32		hash;
+	Cbor	   *result = cbor_lookup(PG_GETARG_DATUM(0), NULL, PG_GETARG_INT32(1), NULL, false);
 
-	hash = cbor_hash_recursive(0, &cbor->root, 0, 1);
+	if (!result)
+		PG_RETURN_NULL();
 
-	PG_FREE_IF_COPY(cbor, 0);
-	PG_RETURN_INT32(hash);
+	PG_RETURN_CBOR(result);
 }
 
+PG_FUNCTION_INFO_V1(cbor_array_element_text);
+Datum
+cbor_array_element_text(PG_FUNCTION_ARGS)
+{
+	text	   *result = cbor_lookup(PG_GETARG_DATUM(0), NULL, PG_GETARG_INT32(1), NULL, true);
 
-static int
-compareCbor(Cbor * a, Cbor * b)
+	if (!result)
+		PG_RETURN_NULL();
+
+	PG_RETURN_TEXT_P(result);
+}
+
+PG_FUNCTION_INFO_V1(cbor_extract_path);
+Datum
+cbor_extract_path(PG_FUNCTION_ARGS)
 {
-	return cbor_cmp_recursive(&a->root, &b->root, 0, 1);
+	Cbor	   *result = cbor_lookup(PG_GETARG_DATUM(0), NULL, 0, PG_GETARG_ARRAYTYPE_P(1), false);
+
+	if (!result)
+		PG_RETURN_NULL();
+
+	PG_RETURN_CBOR(result);
 }
 
-static int
-cbor_cmp_recursive(CborEntry * a, CborEntry * b, int32 nr, int32 cnt)
+PG_FUNCTION_INFO_V1(cbor_extract_path_text);
+Datum
+cbor_extract_path_text(PG_FUNCTION_ARGS)
 {
-	int32		i;
-	uint32		typeA = a[nr] & CBORENTRY_TYPEMASK;
-	uint32		typeB = b[nr] & CBORENTRY_TYPEMASK;
+	text	   *result = cbor_lookup(PG_GETARG_DATUM(0), NULL, 0, PG_GETARG_ARRAYTYPE_P(1), true);
 
-	if (typeA < typeB)
-		return -1;
-	if (typeA > typeB)
-		return 1;
+	if (!result)
+		PG_RETURN_NULL();
 
-	switch (typeA)
+	PG_RETURN_TEXT_P(result);
+}
+
+/*
+ * Find the value referenced by key, index or path, fetching only as much of
+ * the datum as the lookup touches, and return it as cbor or, with as_text,
+ * as text.  Return NULL if there is no such value.
+ */
+static void *
+cbor_lookup(Datum datum, text *key, int32 index, ArrayType *path, bool as_text)
+{
+	CborPrefix	prefix;
+	CborEntry  *entry;
+	int32		nr;
+	int32		cnt;
+	bool		found;
+	void	   *result = NULL;
+
+	cbor_prefix_init(&prefix, datum, CBOR_PREFIX_SIZE);
+	do
 	{
-		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
-		case CBORENTRY_TYPE_NEGATIVEINTEGER:
+		entry = &prefix.cbor->root;
+		nr = 0;
+		cnt = 1;
+		if (key)
+			found = cbor_find_key(&prefix, &entry, &nr, &cnt, VARDATA_ANY(key), VARSIZE_ANY_EXHDR(key));
+		else if (path)
+			found = cbor_find_path(&prefix, &entry, &nr, &cnt, path);
+		else
+			found = cbor_find_index(&prefix, &entry, &nr, &cnt, index);
+		found = found && cbor_prefix_has_entry(&prefix, entry, nr, cnt);
+	} while (cbor_prefix_retry(&prefix));
+
+	if (found)
+		result = as_text ? (void *) cbor_entry_to_text(entry, nr, cnt) : (void *) cbor_from_entry(entry, nr, cnt);
+
+	cbor_prefix_free(&prefix);
+	return result;
+}
+
+/*
+ * Copy the value referenced by entry nr into a new cbor datum.  All offsets
+ * inside a value are relative to its own entries, so only the bytes of the
+ * value itself need to be copied.
+ */
+Cbor *
+cbor_from_entry(CborEntry * entry, int32 nr, int32 cnt)
+{
+	uint32		off = CBORENTRY_OFF(entry, nr);
+	uint32		len = CBORENTRY_ENDPOS(entry, nr) - off;
+	Size		size = offsetof(Cbor, root) + sizeof(CborEntry) + len;
+	Cbor	   *result = palloc(size);
+
+	SET_VARSIZE(result, size);
+	result->root = (entry[nr] & CBORENTRY_TYPEMASK) | len;
+	memcpy(&result->root + 1, CBORENTRY_VALUE(entry, nr, cnt), len);
+
+	return result;
+}
+
+/*
+ * Text strings are returned as their content, null as SQL NULL and
+ * everything else in its textual representation.
+ */
+text *
+cbor_entry_to_text(CborEntry * entry, int32 nr, int32 cnt)
+{
+	StringInfoData buf;
+
+	switch (entry[nr] & CBORENTRY_TYPEMASK)
+	{
+		case CBORENTRY_TYPE_TEXTSTRING:
 			{
-				uint64	   *valueA = CBORENTRY_VALUE(a, nr, cnt);
-				uint64	   *valueB = CBORENTRY_VALUE(b, nr, cnt);
+				int			len = CBORENTRY_STRLEN(entry, nr, cnt);
+				const char *str = cbor_string_to_server(CBORENTRY_GETSTR(entry, nr, cnt), &len);
 
-				if (*valueA < *valueB)
-					return -1;
-				if (*valueA > *valueB)
-					return 1;
-				break;
+				return cstring_to_text_with_len(str, len);
 			}
 
-		case CBORENTRY_TYPE_BYTESTRING:
-		case CBORENTRY_TYPE_TEXTSTRING:
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
 			{
-				return lengthCompareCborText(CBORENTRY_VALUE(a, nr, cnt), CBORENTRY_VALUE(b, nr, cnt));
+				uint64		value = cbor_get_scalar(entry, nr, cnt);
+
+				if (value == (CBOR_SIMPLE_VALUE | CBOR_SIMPLE_NULL))
+					return NULL;
+				break;
 			}
+	}
+
+	initStringInfo(&buf);
+	cbor_out_helper(&buf, entry, nr, cnt);
+
+	return cstring_to_text_with_len(buf.data, buf.len);
+}
+
+/*
+ * Convert the UTF-8 bytes of a text string into the server encoding and
+ * return them, or str itself if they need no conversion.  Text strings are
+ * not checked when they are decoded, so invalid sequences are rejected here,
+ * as is the null character, which text cannot hold.
+ */
+const char *
+cbor_string_to_server(const char *str, int *len)
+{
+	char	   *result;
 
+	if (memchr(str, '\0', *len))
+		ereport(ERROR,
+				(errcode(ERRCODE_UNTRANSLATABLE_CHARACTER),
+				 errmsg("unsupported Unicode character"),
+				 errdetail("\\u0000 cannot be converted to text.")));
+
+	pg_verify_mbstr(PG_UTF8, str, *len, false);
+
+	result = pg_any_to_server(str, *len, PG_UTF8);
+	if (result != str)
+		*len = strlen(result);
+
+	return result;
+}
+
+/*
+ * Replace the referenced map by the value of its first text string key
+ * matching key.
+ */
+static bool
+cbor_find_key(CborPrefix * prefix, CborEntry ** entry, int32 * nr, int32 * cnt, const char *key, int32 keylen)
+{
+	CborContainer *value;
+	int32		i;
+
+	if (((*entry)[*nr] & CBORENTRY_TYPEMASK) != CBORENTRY_TYPE_MAP)
+		return false;
+
+	value = CBORENTRY_VALUE(*entry, *nr, *cnt);
+	i = cbor_map_lookup(prefix, value, CBORENTRY_TYPE_TEXTSTRING, key, keylen, 0);
+	if (i < 0)
+		return false;
+
+	*entry = value->entries;
+	*nr = i;
+	*cnt = CBORCONTAINER_COUNT(value) * 2;
+	return true;
+}
+
+/*
+ * Replace the referenced array by its element at index, counting from the
+ * end for negative indexes.  For maps index is matched against the integer
+ * keys instead.
+ */
+static bool
+cbor_find_index(CborPrefix * prefix, CborEntry ** entry, int32 * nr, int32 * cnt, int32 index)
+{
+	CborContainer *value;
+	int32		i;
+
+	switch ((*entry)[*nr] & CBORENTRY_TYPEMASK)
+	{
 		case CBORENTRY_TYPE_ARRAY:
-			{
-				CborContainer *valueA = CBORENTRY_VALUE(a, nr, cnt);
-				CborContainer *valueB = CBORENTRY_VALUE(b, nr, cnt);
-
-				if (valueA->count < valueB->count)
-					return -1;
-				if (valueA->count > valueB->count)
-					return 1;
-				for (i = 0; i < valueA->count; ++i)
+			value = CBORENTRY_VALUE(*entry, *nr, *cnt);
+			if (!cbor_prefix_has(prefix, value, offsetof(CborContainer, entries)))
+				return false;
+			if (index < 0)
+				index += value->count;
+			if (index < 0 || index >= value->count)
+				return false;
+			if (!cbor_prefix_has(prefix, &value->entries[index], sizeof(CborEntry)))
+				return false;
+
+			*entry = value->entries;
+			*nr = index;
+			*cnt = value->count;
+			return true;
+
+		case CBORENTRY_TYPE_MAP:
+			value = CBORENTRY_VALUE(*entry, *nr, *cnt);
+			if (index < 0)
+				i = cbor_map_lookup(prefix, value, CBORENTRY_TYPE_NEGATIVEINTEGER, NULL, 0, (uint64) (-1 - (int64) index));
+			else
+				i = cbor_map_lookup(prefix, value, CBORENTRY_TYPE_UNSIGNEDINTEGER, NULL, 0, (uint64) index);
+			if (i < 0)
+				return false;
+
+			*entry = value->entries;
+			*nr = i;
+			*cnt = CBORCONTAINER_COUNT(value) * 2;
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Return the entry number of the value belonging to the first key equal to
+ * the given text string or integer, or -1 if there is none or the bytes to
+ * decide it have not been fetched yet.  Sorted maps are searched binary,
+ * all others linear.
+ */
+static int32
+cbor_map_lookup(CborPrefix * prefix, CborContainer * value, CborEntry type, const char *str, int32 len, uint64 uint)
+{
+	int32		count;
+	int32		i;
+
+	if (!cbor_prefix_has(prefix, value, offsetof(CborContainer, entries)))
+		return -1;
+	count = CBORCONTAINER_COUNT(value);
+	if (!cbor_prefix_has(prefix, value->entries, count * 2 * sizeof(CborEntry)))
+		return -1;
+
+	if (CBORCONTAINER_IS_SORTED(value))
+	{
+		int32		lower = 0;
+		int32		upper = count;
+
+		while (lower < upper)
+		{
+			int32		middle = lower + (upper - lower) / 2;
+
+			int			res = cbor_cmp_probe(prefix, value->entries, middle * 2, count * 2, type, str, len, uint);
+
+			if (prefix->need)
+				return -1;
+			if (res < 0)
+				lower = middle + 1;
+			else
+				upper = middle;
+		}
+
+		if (lower < count && cbor_cmp_probe(prefix, value->entries, lower * 2, count * 2, type, str, len, uint) == 0 && !prefix->need)
+			return lower * 2 + 1;
+		return -1;
+	}
+
+	for (i = 0; i < count; ++i)
+	{
+		int			res = cbor_cmp_probe(prefix, value->entries, i * 2, count * 2, type, str, len, uint);
+
+		if (prefix->need)
+			return -1;
+		if (res == 0)
+			return i * 2 + 1;
+	}
+
+	return -1;
+}
+
+/*
+ * Compare entry nr against a text string or integer key in the order
+ * defined by cbor_cmp_entry.
+ */
+static int
+cbor_cmp_probe(CborPrefix * prefix, CborEntry * entry, int32 nr, int32 cnt, CborEntry type, const char *str, int32 len, uint64 uint)
+{
+	uint32		entryType = entry[nr] & CBORENTRY_TYPEMASK;
+
+	if (entryType != type)
+		return entryType < type ? -1 : 1;
+
+	if (type == CBORENTRY_TYPE_TEXTSTRING)
+	{
+		int32		entryLen;
+
+		if (!cbor_prefix_has(prefix, CBORENTRY_VALUE(entry, nr, cnt), VARHDRSZ))
+			return 0;
+		entryLen = CBORENTRY_STRLEN(entry, nr, cnt);
+		if (entryLen != len)
+			return entryLen < len ? -1 : 1;
+		if (!cbor_prefix_has(prefix, CBORENTRY_GETSTR(entry, nr, cnt), len))
+			return 0;
+		return memcmp(CBORENTRY_GETSTR(entry, nr, cnt), str, len);
+	}
+	else
+	{
+		uint64		value;
+
+		if (!cbor_prefix_has_entry(prefix, entry, nr, cnt))
+			return 0;
+		value = cbor_get_scalar(entry, nr, cnt);
+
+		if (value != uint)
+			return value < uint ? -1 : 1;
+		return 0;
+	}
+}
+
+/*
+ * Follow a path of map keys and array indexes.  Path elements are used as
+ * map keys for maps and parsed as integer indexes for arrays.
+ */
+static bool
+cbor_find_path(CborPrefix * prefix, CborEntry ** entry, int32 * nr, int32 * cnt, ArrayType *path)
+{
+	Datum	   *elems;
+	bool	   *nulls;
+	int			nelems;
+	int			i;
+
+	if (ARR_NDIM(path) > 1)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("wrong number of array subscripts")));
+
+	deconstruct_array(path, TEXTOID, -1, false, 'i', &elems, &nulls, &nelems);
+
+	for (i = 0; i < nelems; ++i)
+	{
+		text	   *elem;
+
+		if (nulls[i])
+			return false;
+
+		elem = DatumGetTextPP(elems[i]);
+
+		switch ((*entry)[*nr] & CBORENTRY_TYPEMASK)
+		{
+			case CBORENTRY_TYPE_MAP:
+				if (!cbor_find_key(prefix, entry, nr, cnt, VARDATA_ANY(elem), VARSIZE_ANY_EXHDR(elem)))
+					return false;
+				break;
+
+			case CBORENTRY_TYPE_ARRAY:
 				{
-					int			tmp = cbor_cmp_recursive(a, b, i, valueA->count);
+					char	   *str = text_to_cstring(elem);
+					char	   *end;
+					long		index;
 
-					if (tmp)
-						return tmp;
+					errno = 0;
+					index = strtol(str, &end, 10);
+					if (end == str || *end != '\0' || errno != 0 || index < PG_INT32_MIN || index > PG_INT32_MAX)
+						return false;
+					if (!cbor_find_index(prefix, entry, nr, cnt, index))
+						return false;
+					break;
 				}
-				break;
+
+			default:
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+static int
+compareCbor(Cbor * a, Cbor * b)
+{
+	return cbor_cmp_entry(&a->root, 0, 1, &b->root, 0, 1);
+}
+
+static int
+compareCborDatum(Datum x, Datum y)
+{
+	CborPrefix	a;
+	CborPrefix	b;
+	instr_time	start;
+	int			res = 0;
+
+	if (cbor_track_stats)
+		INSTR_TIME_SET_CURRENT(start);
+
+	cbor_prefix_init(&a, x, CBOR_PREFIX_SIZE);
+	cbor_prefix_init(&b, y, CBOR_PREFIX_SIZE);
+
+	if (a.avail < a.size || b.avail < b.size)
+		res = cbor_cmp_prefix(&a, &b);
+
+	if (res == 0)
+	{
+		cbor_prefix_fetch(&a, a.size);
+		cbor_prefix_fetch(&b, b.size);
+		res = compareCbor(a.cbor, b.cbor);
+	}
+
+	if (cbor_track_stats)
+		cbor_stats_add(&cbor_counters.compare, a.avail + b.avail, &start);
+
+	cbor_prefix_free(&a);
+	cbor_prefix_free(&b);
+	return res;
+}
+
+/*
+ * Compare the parts two partially fetched values have in common in the
+ * order of cbor_cmp_entry: the types, the lengths of strings and
+ * containers, the start of strings and the elements of arrays and unsorted
+ * maps as far as they have been fetched completely.  Return 0 if that does
+ * not decide the order.
+ */
+static int
+cbor_cmp_prefix(CborPrefix * a, CborPrefix * b)
+{
+	CborEntry  *rootA = &a->cbor->root;
+	CborEntry  *rootB = &b->cbor->root;
+	uint32		typeA = *rootA & CBORENTRY_TYPEMASK;
+	uint32		typeB = *rootB & CBORENTRY_TYPEMASK;
+	int32		i;
+
+	if (typeA != typeB)
+		return typeA < typeB ? -1 : 1;
+
+	switch (typeA)
+	{
+		case CBORENTRY_TYPE_BYTESTRING:
+		case CBORENTRY_TYPE_TEXTSTRING:
+			{
+				char	   *strA = CBORENTRY_GETSTR(rootA, 0, 1);
+				char	   *strB = CBORENTRY_GETSTR(rootB, 0, 1);
+				uint32		lenA;
+				uint32		lenB;
+				Size		len;
+
+				if (!cbor_prefix_has(a, CBORENTRY_VALUE(rootA, 0, 1), VARHDRSZ) ||
+					!cbor_prefix_has(b, CBORENTRY_VALUE(rootB, 0, 1), VARHDRSZ))
+					break;
+
+				lenA = CBORENTRY_STRLEN(rootA, 0, 1);
+				lenB = CBORENTRY_STRLEN(rootB, 0, 1);
+				if (lenA != lenB)
+					return lenA < lenB ? -1 : 1;
+
+				len = Min((char *) a->cbor + a->avail - strA, (char *) b->cbor + b->avail - strB);
+				return memcmp(strA, strB, Min(len, lenA));
 			}
 
+		case CBORENTRY_TYPE_ARRAY:
 		case CBORENTRY_TYPE_MAP:
 			{
-				CborContainer *valueA = CBORENTRY_VALUE(a, nr, cnt);
-				CborContainer *valueB = CBORENTRY_VALUE(b, nr, cnt);
-
-				if (valueA->count < valueB->count)
-					return -1;
-				if (valueA->count > valueB->count)
-					return 1;
-				for (i = 0; i < valueA->count * 2; ++i)
+				CborContainer *valueA = CBORENTRY_VALUE(rootA, 0, 1);
+				CborContainer *valueB = CBORENTRY_VALUE(rootB, 0, 1);
+				int32		count;
+
+				if (!cbor_prefix_has(a, valueA, offsetof(CborContainer, entries)) ||
+					!cbor_prefix_has(b, valueB, offsetof(CborContainer, entries)))
+					break;
+
+				count = CBORCONTAINER_COUNT(valueA);
+				if (count != CBORCONTAINER_COUNT(valueB))
+					return count < CBORCONTAINER_COUNT(valueB) ? -1 : 1;
+
+				/*
+				 * Sorted maps keep their original order at the very end.  If
+				 * only one side is sorted, its entries are not in the order
+				 * they are compared in either.
+				 */
+				if (CBORCONTAINER_IS_SORTED(valueA) || CBORCONTAINER_IS_SORTED(valueB))
+					return 0;
+
+				if (typeA == CBORENTRY_TYPE_MAP)
+					count *= 2;
+
+				for (i = 0; i < count; ++i)
 				{
-					int			tmp = cbor_cmp_recursive(a, b, i, valueA->count * 2);
+					int			res;
 
-					if (tmp)
-						return tmp;
+					if (!cbor_prefix_has(a, &valueA->entries[i], sizeof(CborEntry)) ||
+						!cbor_prefix_has(b, &valueB->entries[i], sizeof(CborEntry)) ||
+						!cbor_prefix_has_entry(a, valueA->entries, i, count) ||
+						!cbor_prefix_has_entry(b, valueB->entries, i, count))
+						break;
+
+					res = cbor_cmp_entry(valueA->entries, i, count, valueB->entries, i, count);
+					if (res)
+						return res;
 				}
 				break;
 			}
 
 		case CBORENTRY_TYPE_TAG:
 			{
-				CborTag    *valueA = CBORENTRY_VALUE(a, nr, cnt);
-				CborTag    *valueB = CBORENTRY_VALUE(b, nr, cnt);
-
-				if (valueA->value < valueB->value)
-					return -1;
-				if (valueA->value > valueB->value)
-					return 1;
-				return cbor_cmp_recursive(a, b, 0, 1);
-			}
+				CborTag    *valueA = CBORENTRY_VALUE(rootA, 0, 1);
+				CborTag    *valueB = CBORENTRY_VALUE(rootB, 0, 1);
 
-		case CBORENTRY_TYPE_FLOATORSIMPLE:
-			{
-				uint64	   *valueA = CBORENTRY_VALUE(a, nr, cnt);
-				uint64	   *valueB = CBORENTRY_VALUE(b, nr, cnt);
+				if (!cbor_prefix_has(a, valueA, sizeof(valueA->value)) ||
+					!cbor_prefix_has(b, valueB, sizeof(valueB->value)))
+					break;
 
-				if ((*valueA & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
-				{
-					uint8		simpleA = *valueA & 0xFF;
-					uint8		simpleB = *valueB & 0xFF;
-
-					if ((*valueB & CBOR_SIMPLEMASK) != CBOR_SIMPLE_VALUE)
-						return -1;
-					if (simpleA < simpleB)
-						return -1;
-					if (simpleA > simpleB)
-						return 1;
-				}
-				else
-				{
-					double		fltA = *((double *) valueA);
-					double		fltB = *((double *) valueB);
-
-					if ((*valueB & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
-						return 1;
-					if (fltA < fltB)
-						return -1;
-					if (fltA > fltB)
-						return 1;
-				}
+				if (valueA->value != valueB->value)
+					return valueA->value < valueB->value ? -1 : 1;
 				break;
 			}
 	}
 
+	a->need = 0;
+	b->need = 0;
 	return 0;
 }
 
-static uint32
-cbor_hash_recursive(uint32 hash, CborEntry * entry, int32 nr, int32 cnt)
+static void
+cbor_prefix_init(CborPrefix * prefix, Datum datum, Size size)
 {
-	int32		i;
-	uint32		type = entry[nr] & CBORENTRY_TYPEMASK;
+	struct varlena *attr = (struct varlena *) DatumGetPointer(datum);
+
+	prefix->datum = datum;
+	prefix->cbor = NULL;
+	prefix->avail = 0;
+	prefix->size = toast_raw_datum_size(datum);
+	prefix->need = 0;
+
+	/*
+	 * Slices of compressed values are decompressed only as far as needed
+	 * from PostgreSQL 12 on, before that the whole value is decompressed.
+	 */
+	if (VARATT_IS_EXTERNAL_ONDISK(attr))
+	{
+#if PG_VERSION_NUM < 120000
+		struct varatt_external toast_pointer;
+
+		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+		if (VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+			size = prefix->size;
+#endif
+	}
+	else
+		size = prefix->size;
+
+	cbor_prefix_fetch(prefix, size);
+}
+
+/*
+ * Make at least size bytes of the value available, at least doubling the
+ * fetched part to bound the number of fetches.
+ */
+static void
+cbor_prefix_fetch(CborPrefix * prefix, Size size)
+{
+	Cbor	   *cbor;
+
+	if (size <= prefix->avail)
+		return;
+
+	size = Max(size, prefix->avail * 2);
+	if (size >= prefix->size)
+	{
+		cbor = DatumGetCbor(PG_DETOAST_DATUM(prefix->datum));
+		size = prefix->size;
+	}
+	else
+		cbor = DatumGetCbor(PG_DETOAST_DATUM_SLICE(prefix->datum, 0, size - VARHDRSZ));
+
+	if (cbor_track_stats && (Pointer) cbor != DatumGetPointer(prefix->datum))
+		cbor_stats_add(&cbor_counters.detoast, VARSIZE(cbor), NULL);
 
-	hash ^= type;
-	hash = (hash << 1) | (hash >> 31);
+	cbor_prefix_free(prefix);
+	prefix->cbor = cbor;
+	prefix->avail = size;
+}
+
+/*
+ * Fetch the bytes the last operation was missing and return whether it has
+ * to be repeated.
+ */
+static bool
+cbor_prefix_retry(CborPrefix * prefix)
+{
+	Size		need = prefix->need;
+
+	if (need == 0)
+		return false;
+
+	prefix->need = 0;
+	cbor_prefix_fetch(prefix, need);
+	return true;
+}
+
+static void
+cbor_prefix_free(CborPrefix * prefix)
+{
+	if (prefix->cbor && (Pointer) prefix->cbor != DatumGetPointer(prefix->datum))
+		pfree(prefix->cbor);
+	prefix->cbor = NULL;
+}
+
+/*
+ * Return whether the len bytes at ptr have been fetched and otherwise note
+ * them as needed.
+ */
+static bool
+cbor_prefix_has(CborPrefix * prefix, const void *ptr, Size len)
+{
+	Size		end = (const char *) ptr + len - (const char *) prefix->cbor;
+
+	if (end <= prefix->avail)
+		return true;
+
+	prefix->need = Max(prefix->need, end);
+	return false;
+}
+
+static bool
+cbor_prefix_has_entry(CborPrefix * prefix, CborEntry * entry, int32 nr, int32 cnt)
+{
+	return cbor_prefix_has(prefix, CBORENTRY_VALUE(entry, nr, cnt), CBORENTRY_WIDTH(entry, nr));
+}
+
+static int
+cbor_cmp_fast(Datum x, Datum y, SortSupport ssup)
+{
+	return compareCborDatum(x, y);
+}
+
+#if PG_VERSION_NUM >= 90500
+static int
+cbor_cmp_abbrev(Datum x, Datum y, SortSupport ssup)
+{
+	if (x < y)
+		return -1;
+	if (x > y)
+		return 1;
+	return 0;
+}
+
+static Datum
+cbor_abbrev_convert(Datum original, SortSupport ssup)
+{
+	CborSortSupport *sss = ssup->ssup_extra;
+	CborPrefix	prefix;
+	uint64		key;
+
+	cbor_prefix_init(&prefix, original, CBOR_PREFIX_SIZE);
+	do
+		key = cbor_abbrev_entry(&prefix, &prefix.cbor->root, 0, 1);
+	while (cbor_prefix_retry(&prefix));
+	cbor_prefix_free(&prefix);
+
+	addHyperLogLog(&sss->abbr_card, DatumGetUInt32(hash_uint32((uint32) (key ^ (key >> 32)))));
+	sss->input_count++;
+
+#if SIZEOF_DATUM == 8
+	return (Datum) key;
+#else
+	return (Datum) (key >> 32);
+#endif
+}
+
+/*
+ * Stop abbreviating once a sample of 10000 values shows less than one
+ * distinct abbreviated key per 2000 values, like values sharing a long
+ * array prefix do.
+ */
+static bool
+cbor_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+	CborSortSupport *sss = ssup->ssup_extra;
+	double		abbr_card;
+
+	if (memtupcount < 10000 || sss->input_count < 10000)
+		return false;
+
+	abbr_card = estimateHyperLogLog(&sss->abbr_card);
+
+	return abbr_card < sss->input_count / 2000.0 + 0.5;
+}
+#endif
+
+/*
+ * Return a key whose unsigned order agrees with cbor_cmp_entry wherever
+ * two keys differ.  The top 3 bits hold the type and the remaining 61 bits
+ * the start of the value: integers and tag numbers without their low bits,
+ * strings and containers with their length in 29 bits followed by the first
+ * 4 bytes or the top half of the key of the first element, and floats in an
+ * order preserving bit pattern above all simple values.
+ */
+static uint64
+cbor_abbrev_entry(CborPrefix * prefix, CborEntry * entry, int32 nr, int32 cnt)
+{
+	CborEntry	type = entry[nr] & CBORENTRY_TYPEMASK;
+	uint64		key = (uint64) type << 32;
 
 	switch (type)
 	{
 		case CBORENTRY_TYPE_UNSIGNEDINTEGER:
 		case CBORENTRY_TYPE_NEGATIVEINTEGER:
-		case CBORENTRY_TYPE_FLOATORSIMPLE:
-			{
-				hash ^= DatumGetUInt32(hash_any(CBORENTRY_VALUE(entry, nr, cnt), sizeof(uint64)));
-				break;
-			}
+			if (!cbor_prefix_has_entry(prefix, entry, nr, cnt))
+				return 0;
+			return key | (cbor_get_scalar(entry, nr, cnt) >> 3);
 
 		case CBORENTRY_TYPE_BYTESTRING:
 		case CBORENTRY_TYPE_TEXTSTRING:
 			{
-				bytea	   *value = CBORENTRY_VALUE(entry, nr, cnt);
+				const unsigned char *str = (const unsigned char *) CBORENTRY_GETSTR(entry, nr, cnt);
+				uint32		len;
+				uint32		head = 0;
+				uint32		i;
 
-				hash ^= DatumGetUInt32(hash_any((unsigned char *) value, VARHDRSZ + VARSIZE(value)));
-				break;
+				if (!cbor_prefix_has(prefix, CBORENTRY_VALUE(entry, nr, cnt), VARHDRSZ))
+					return 0;
+				len = CBORENTRY_STRLEN(entry, nr, cnt);
+				if (!cbor_prefix_has(prefix, str, Min(len, 4)))
+					return 0;
+
+				for (i = 0; i < 4 && i < len; ++i)
+					head |= (uint32) str[i] << (24 - 8 * i);
+				return key | ((uint64) len << 32) | head;
 			}
 
 		case CBORENTRY_TYPE_ARRAY:
 			{
 				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
 
-				for (i = 0; i < value->count; ++i)
-					hash = cbor_hash_recursive(hash, value->entries, i, value->count);
-				break;
+				if (!cbor_prefix_has(prefix, value, offsetof(CborContainer, entries)))
+					return 0;
+				key |= (uint64) value->count << 32;
+				if (value->count)
+				{
+					if (!cbor_prefix_has(prefix, value->entries, sizeof(CborEntry)))
+						return 0;
+					key |= cbor_abbrev_entry(prefix, value->entries, 0, value->count) >> 32;
+				}
+				return key;
 			}
 
 		case CBORENTRY_TYPE_MAP:
 			{
 				CborContainer *value = CBORENTRY_VALUE(entry, nr, cnt);
+				int32		count;
+				int32		first = 0;
 
-				for (i = 0; i < value->count * 2; ++i)
-					hash = cbor_hash_recursive(hash, value->entries, i, value->count * 2);
-				break;
+				if (!cbor_prefix_has(prefix, value, offsetof(CborContainer, entries)))
+					return 0;
+				count = CBORCONTAINER_COUNT(value);
+				if (count == 0)
+					return key;
+				if (!cbor_prefix_has(prefix, value->entries, count * 2 * sizeof(CborEntry)))
+					return 0;
+				if (CBORCONTAINER_IS_SORTED(value))
+				{
+					if (!cbor_prefix_has(prefix, CBORCONTAINER_ORDER(value), sizeof(uint32)))
+						return 0;
+					first = CBORCONTAINER_ORDER(value)[0] * 2;
+				}
+
+				key |= (uint64) count << 32;
+				return key | (cbor_abbrev_entry(prefix, value->entries, first, count * 2) >> 32);
 			}
 
 		case CBORENTRY_TYPE_TAG:
 			{
 				CborTag    *value = CBORENTRY_VALUE(entry, nr, cnt);
 
-				hash ^= DatumGetUInt32(hash_any((unsigned char *) &value->value, sizeof(value->value)));
-				hash = cbor_hash_recursive(hash, &value->entry, 0, 1);
-				break;
+				if (!cbor_prefix_has(prefix, value, sizeof(value->value)))
+					return 0;
+				return key | (value->value >> 3);
+			}
+
+		case CBORENTRY_TYPE_FLOATORSIMPLE:
+			{
+				uint64		value;
+				double		flt;
+
+				if (!cbor_prefix_has_entry(prefix, entry, nr, cnt))
+					return 0;
+				value = cbor_get_scalar(entry, nr, cnt);
+				if ((value & CBOR_SIMPLEMASK) == CBOR_SIMPLE_VALUE)
+					return key | (value & 0xFF);
+
+				memcpy(&flt, &value, sizeof(flt));
+				if (isnan(flt))
+					value = PG_UINT64_MAX;
+				else if (flt == 0.0)
+					value = UINT64CONST(0x8000000000000000);
+				else if (value & UINT64CONST(0x8000000000000000))
+					value = ~value;
+				else
+					value |= UINT64CONST(0x8000000000000000);
+				return key | (UINT64CONST(1) << 60) | (value >> 4);
 			}
 	}
 
-	return hash;
+	return key;
 }
 
-static int
-lengthCompareCborText(const struct varlena * a, const struct varlena * b)
+/*
+ * A map contains another map if it has all its keys with values containing
+ * the values of the other map.  An array contains another array if every
+ * element of the other array is contained in one of its elements,
+ * independent of order and duplicates.  Tags need the same number and
+ * everything else has to be equal.
+ */
+static bool
+cbor_contains_recursive(CborEntry * a, int32 nrA, int32 cntA, CborEntry * b, int32 nrB, int32 cntB)
 {
-	if (VARSIZE(a) == VARSIZE(b))
-		return memcmp(VARDATA(a), VARDATA(b), VARSIZE(a) - VARHDRSZ);
-	if (VARSIZE(a) < VARSIZE(b))
-		return -1;
-	return 1;
+	int32		i;
+	int32		j;
+	uint32		type = a[nrA] & CBORENTRY_TYPEMASK;
+
+	check_stack_depth();
+
+	if (type != (b[nrB] & CBORENTRY_TYPEMASK))
+		return false;
+
+	switch (type)
+	{
+		case CBORENTRY_TYPE_ARRAY:
+			{
+				CborContainer *valueA = CBORENTRY_VALUE(a, nrA, cntA);
+				CborContainer *valueB = CBORENTRY_VALUE(b, nrB, cntB);
+
+				for (j = 0; j < valueB->count; ++j)
+				{
+					for (i = 0; i < valueA->count; ++i)
+					{
+						if (cbor_contains_recursive(valueA->entries, i, valueA->count, valueB->entries, j, valueB->count))
+							break;
+					}
+					if (i == valueA->count)
+						return false;
+				}
+				return true;
+			}
+
+		case CBORENTRY_TYPE_MAP:
+			{
+				CborContainer *valueA = CBORENTRY_VALUE(a, nrA, cntA);
+				CborContainer *valueB = CBORENTRY_VALUE(b, nrB, cntB);
+				int32		count2 = CBORCONTAINER_COUNT(valueB) * 2;
+
+				for (j = 0; j < count2; j += 2)
+				{
+					if (!cbor_contains_pair(valueA, valueB->entries, j, count2))
+						return false;
+				}
+				return true;
+			}
+
+		case CBORENTRY_TYPE_TAG:
+			{
+				CborTag    *valueA = CBORENTRY_VALUE(a, nrA, cntA);
+				CborTag    *valueB = CBORENTRY_VALUE(b, nrB, cntB);
+
+				if (valueA->value != valueB->value)
+					return false;
+				return cbor_contains_recursive(&valueA->entry, 0, 1, &valueB->entry, 0, 1);
+			}
+	}
+
+	return cbor_cmp_entry(a, nrA, cntA, b, nrB, cntB) == 0;
+}
+
+/*
+ * Check whether map a has a pair with the key at entry nrB whose value
+ * contains the value behind that key.
+ */
+static bool
+cbor_contains_pair(CborContainer * a, CborEntry * b, int32 nrB, int32 cntB)
+{
+	int32		count = CBORCONTAINER_COUNT(a);
+	int32		i = 0;
+
+	if (CBORCONTAINER_IS_SORTED(a))
+	{
+		int32		upper = count;
+
+		while (i < upper)
+		{
+			int32		middle = i + (upper - i) / 2;
+
+			if (cbor_cmp_entry(a->entries, middle * 2, count * 2, b, nrB, cntB) < 0)
+				i = middle + 1;
+			else
+				upper = middle;
+		}
+	}
+
+	for (; i < count; ++i)
+	{
+		int			cmp = cbor_cmp_entry(a->entries, i * 2, count * 2, b, nrB, cntB);
+
+		if (cmp == 0)
+		{
+			if (cbor_contains_recursive(a->entries, i * 2 + 1, count * 2, b, nrB + 1, cntB))
+				return true;
+		}
+		else if (CBORCONTAINER_IS_SORTED(a))
+			break;
+	}
+
+	return false;
 }
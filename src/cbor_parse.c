@@ -0,0 +1,567 @@
+#include "cbor.h"
+#include <math.h>
+
+#include "miscadmin.h"
+
+/*
+ * The text parser is a recursive descent parser over the diagnostic
+ * notation, which writes the value in the binary encoding into a single
+ * buffer.  Arrays and maps are written with indefinite lengths, so nothing
+ * has to be known in advance, and the binary decoder then builds the entry
+ * layout from it with exact sizes.
+ */
+typedef struct CborParseState
+{
+	const char *cursor;
+	StringInfo	out;
+}	CborParseState;
+
+#define CBOR_PARSE_ISSPACE(ch) ((ch) == ' ' || (ch) == '\t' || (ch) == '\n' || (ch) == '\r' || (ch) == '\f')
+#define CBOR_PARSE_ISDIGIT(ch) ((ch) >= '0' && (ch) <= '9')
+#define CBOR_PARSE_ISALPHA(ch) (((ch) >= 'a' && (ch) <= 'z') || ((ch) >= 'A' && (ch) <= 'Z'))
+
+static void cbor_parse_value(CborParseState * state);
+
+
+static void
+cbor_parse_error(CborParseState * state)
+{
+	const char *end = state->cursor;
+
+	if (*state->cursor == '\0')
+		ereport(ERROR,
+				(errcode(ERRCODE_SYNTAX_ERROR),
+				 errmsg("bad cbor representation"),
+				 errdetail("syntax error at end of input")));
+
+	while (CBOR_PARSE_ISALPHA(*end) || CBOR_PARSE_ISDIGIT(*end))
+		end++;
+	if (end == state->cursor)
+		end++;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_SYNTAX_ERROR),
+			 errmsg("bad cbor representation"),
+			 errdetail("syntax error at or near \"%.*s\"",
+					   (int) (end - state->cursor), state->cursor)));
+}
+
+static inline void
+cbor_parse_skip_space(CborParseState * state)
+{
+	while (CBOR_PARSE_ISSPACE(*state->cursor))
+		state->cursor++;
+}
+
+static inline void
+cbor_parse_expect(CborParseState * state, char ch)
+{
+	cbor_parse_skip_space(state);
+	if (*state->cursor != ch)
+		cbor_parse_error(state);
+	state->cursor++;
+}
+
+/*
+ * Append an initial byte with a full 8 byte argument.  The decoder does not
+ * require the shortest form, so there is no need to pick one here.
+ */
+static void
+cbor_parse_append_head(StringInfo out, uint8 type, uint64 value)
+{
+	char	   *data;
+	int			i;
+
+	enlargeStringInfo(out, 9);
+	data = out->data + out->len;
+	data[0] = type | 27;
+	for (i = 8; i > 0; --i)
+	{
+		data[i] = (char) value;
+		value >>= 8;
+	}
+	out->len += 9;
+}
+
+static inline void
+cbor_parse_append_byte(StringInfo out, uint8 byte)
+{
+	appendStringInfoChar(out, (char) byte);
+}
+
+static inline int
+cbor_parse_xdigit(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+static bool
+cbor_parse_keyword(CborParseState * state, const char *keyword, int len)
+{
+	if (strncmp(state->cursor, keyword, len) != 0 || CBOR_PARSE_ISALPHA(state->cursor[len]) || CBOR_PARSE_ISDIGIT(state->cursor[len]))
+		return false;
+	state->cursor += len;
+	return true;
+}
+
+/*
+ * Parse an unsigned decimal integer.
+ */
+static uint64
+cbor_parse_uint(CborParseState * state)
+{
+	const char *start = state->cursor;
+	uint64		value = 0;
+
+	if (!CBOR_PARSE_ISDIGIT(*state->cursor))
+		cbor_parse_error(state);
+
+	while (CBOR_PARSE_ISDIGIT(*state->cursor))
+	{
+		int			digit = *state->cursor - '0';
+
+		if (value > (PG_UINT64_MAX - digit) / 10)
+		{
+			while (CBOR_PARSE_ISDIGIT(*state->cursor))
+				state->cursor++;
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("bad cbor representation"),
+					 errdetail("integer out of range at or near \"%.*s\"",
+							   (int) (state->cursor - start), start)));
+		}
+
+		value = value * 10 + digit;
+		state->cursor++;
+	}
+
+	return value;
+}
+
+/*
+ * Parse a number, which is an integer unless it has a fraction or an
+ * exponent.
+ */
+static void
+cbor_parse_number(CborParseState * state)
+{
+	const char *start = state->cursor;
+	const char *digits;
+	const char *end;
+	bool		negative = *start == '-';
+	bool		is_float = false;
+
+	if (*start == '-' || *start == '+')
+		state->cursor++;
+	digits = state->cursor;
+
+	if (cbor_parse_keyword(state, "Infinity", 8))
+	{
+		appendBinaryStringInfo(state->out, negative ? "\xf9\xfc\x00" : "\xf9\x7c\x00", 3);
+		return;
+	}
+
+	if (!CBOR_PARSE_ISDIGIT(*state->cursor))
+		cbor_parse_error(state);
+	while (CBOR_PARSE_ISDIGIT(*state->cursor))
+		state->cursor++;
+	end = state->cursor;
+
+	if (end[0] == '.' && CBOR_PARSE_ISDIGIT(end[1]))
+	{
+		end++;
+		while (CBOR_PARSE_ISDIGIT(*end))
+			end++;
+		is_float = true;
+	}
+	if (end[0] == 'e' || end[0] == 'E')
+	{
+		const char *exp = end + 1;
+
+		if (*exp == '+' || *exp == '-')
+			exp++;
+		if (CBOR_PARSE_ISDIGIT(*exp))
+		{
+			while (CBOR_PARSE_ISDIGIT(*exp))
+				exp++;
+			end = exp;
+			is_float = true;
+		}
+	}
+
+	if (is_float)
+	{
+		char	   *strtod_end;
+		double		value = strtod(start, &strtod_end);
+		uint64		bits;
+
+		if (strtod_end != end)
+		{
+			state->cursor = start;
+			cbor_parse_error(state);
+		}
+
+		memcpy(&bits, &value, sizeof(bits));
+		cbor_parse_append_head(state->out, 0xe0, bits);
+		state->cursor = end;
+		return;
+	}
+
+	state->cursor = digits;
+
+	if (negative)
+	{
+		uint64		value;
+
+		/* -2^64 is the only value which does not fit into an uint64 */
+		if (end - digits == 20 && strncmp(digits, "18446744073709551616", 20) == 0)
+		{
+			state->cursor = end;
+			cbor_parse_append_head(state->out, 0x20, PG_UINT64_MAX);
+			return;
+		}
+
+		value = cbor_parse_uint(state);
+		if (value == 0)
+			cbor_parse_append_head(state->out, 0x00, 0);	/* -0 is zero */
+		else
+			cbor_parse_append_head(state->out, 0x20, value - 1);
+	}
+	else
+	{
+		uint64		value = cbor_parse_uint(state);
+
+		cbor_parse_skip_space(state);
+		if (*state->cursor != '(')
+		{
+			cbor_parse_append_head(state->out, 0x00, value);
+			return;
+		}
+
+		/* a tagged value */
+		state->cursor++;
+		cbor_parse_append_head(state->out, 0xc0, value);
+		cbor_parse_value(state);
+		cbor_parse_expect(state, ')');
+	}
+}
+
+static void
+cbor_parse_byte_string(CborParseState * state)
+{
+	const char *start = state->cursor;
+	const char *end = start;
+	char	   *data;
+
+	while (cbor_parse_xdigit(end[0]) >= 0 && cbor_parse_xdigit(end[1]) >= 0)
+		end += 2;
+	if (*end != '\'')
+	{
+		state->cursor = end;
+		cbor_parse_error(state);
+	}
+
+	cbor_parse_append_head(state->out, 0x40, (end - start) / 2);
+	enlargeStringInfo(state->out, (end - start) / 2);
+	data = state->out->data + state->out->len;
+	for (; start < end; start += 2)
+		*data++ = (char) (cbor_parse_xdigit(start[0]) << 4 | cbor_parse_xdigit(start[1]));
+	state->out->len = data - state->out->data;
+	state->out->data[state->out->len] = '\0';
+
+	state->cursor = end + 1;
+}
+
+static void
+cbor_parse_append_utf8(StringInfo out, uint32 ch)
+{
+	char		buf[4];
+	int			len;
+
+	if (ch <= 0x7F)
+	{
+		buf[0] = ch;
+		len = 1;
+	}
+	else if (ch <= 0x7FF)
+	{
+		buf[0] = 0xC0 | (ch >> 6);
+		buf[1] = 0x80 | (ch & 0x3F);
+		len = 2;
+	}
+	else if (ch <= 0xFFFF)
+	{
+		buf[0] = 0xE0 | (ch >> 12);
+		buf[1] = 0x80 | ((ch >> 6) & 0x3F);
+		buf[2] = 0x80 | (ch & 0x3F);
+		len = 3;
+	}
+	else
+	{
+		buf[0] = 0xF0 | (ch >> 18);
+		buf[1] = 0x80 | ((ch >> 12) & 0x3F);
+		buf[2] = 0x80 | ((ch >> 6) & 0x3F);
+		buf[3] = 0x80 | (ch & 0x3F);
+		len = 4;
+	}
+
+	appendBinaryStringInfo(out, buf, len);
+}
+
+static uint32
+cbor_parse_unicode_escape(CborParseState * state)
+{
+	uint32		ch = 0;
+	int			i;
+
+	for (i = 0; i < 4; ++i)
+	{
+		int			digit = cbor_parse_xdigit(state->cursor[i]);
+
+		if (digit < 0)
+		{
+			state->cursor += i;
+			cbor_parse_error(state);
+		}
+		ch = ch << 4 | digit;
+	}
+	state->cursor += 4;
+
+	return ch;
+}
+
+static void
+cbor_parse_text_string(CborParseState * state)
+{
+	StringInfo	out = state->out;
+	int			head;
+	int			i;
+	uint64		len;
+
+	/* the length is filled in when the end of the string is known */
+	head = out->len;
+	cbor_parse_append_head(out, 0x60, 0);
+
+	for (;;)
+	{
+		const char *start = state->cursor;
+
+		while (*state->cursor != '"' && *state->cursor != '\\' && *state->cursor != '\0')
+			state->cursor++;
+		appendBinaryStringInfo(out, start, state->cursor - start);
+
+		if (*state->cursor == '"')
+			break;
+		if (*state->cursor == '\0')
+			cbor_parse_error(state);
+
+		state->cursor++;
+		switch (*state->cursor++)
+		{
+			case '"':
+				appendStringInfoChar(out, '"');
+				break;
+			case '\\':
+				appendStringInfoChar(out, '\\');
+				break;
+			case '/':
+				appendStringInfoChar(out, '/');
+				break;
+			case 'b':
+				appendStringInfoChar(out, '\b');
+				break;
+			case 'f':
+				appendStringInfoChar(out, '\f');
+				break;
+			case 'n':
+				appendStringInfoChar(out, '\n');
+				break;
+			case 'r':
+				appendStringInfoChar(out, '\r');
+				break;
+			case 't':
+				appendStringInfoChar(out, '\t');
+				break;
+			case 'u':
+				{
+					uint32		ch = cbor_parse_unicode_escape(state);
+
+					if (ch >= 0xD800 && ch <= 0xDBFF)
+					{
+						uint32		low;
+
+						if (state->cursor[0] != '\\' || state->cursor[1] != 'u')
+							ereport(ERROR,
+									(errcode(ERRCODE_SYNTAX_ERROR),
+									 errmsg("bad cbor representation"),
+									 errdetail("Unicode high surrogate must be followed by a low surrogate.")));
+						state->cursor += 2;
+						low = cbor_parse_unicode_escape(state);
+						if (low < 0xDC00 || low > 0xDFFF)
+							ereport(ERROR,
+									(errcode(ERRCODE_SYNTAX_ERROR),
+									 errmsg("bad cbor representation"),
+									 errdetail("Unicode high surrogate must be followed by a low surrogate.")));
+						ch = 0x10000 + ((ch - 0xD800) << 10) + (low - 0xDC00);
+					}
+					else if (ch >= 0xDC00 && ch <= 0xDFFF)
+						ereport(ERROR,
+								(errcode(ERRCODE_SYNTAX_ERROR),
+								 errmsg("bad cbor representation"),
+								 errdetail("Unicode low surrogate must follow a high surrogate.")));
+
+					cbor_parse_append_utf8(out, ch);
+					break;
+				}
+			default:
+				state->cursor -= 2;
+				cbor_parse_error(state);
+		}
+	}
+	state->cursor++;
+
+	len = out->len - head - 9;
+	for (i = 8; i > 0; --i)
+	{
+		out->data[head + i] = (char) len;
+		len >>= 8;
+	}
+}
+
+static void
+cbor_parse_container(CborParseState * state, uint8 type, char close)
+{
+	cbor_parse_append_byte(state->out, type | CBORENTRY_INDEFINITE);
+
+	cbor_parse_skip_space(state);
+	if (*state->cursor == close)
+		state->cursor++;
+	else
+	{
+		for (;;)
+		{
+			cbor_parse_value(state);
+			if (type == 0xa0)
+			{
+				cbor_parse_expect(state, ':');
+				cbor_parse_value(state);
+			}
+
+			cbor_parse_skip_space(state);
+			if (*state->cursor == close)
+			{
+				state->cursor++;
+				break;
+			}
+			if (*state->cursor != ',')
+				cbor_parse_error(state);
+			state->cursor++;
+		}
+	}
+
+	cbor_parse_append_byte(state->out, CBORENTRY_BREAK);
+}
+
+static void
+cbor_parse_value(CborParseState * state)
+{
+	check_stack_depth();
+
+	cbor_parse_skip_space(state);
+
+	switch (*state->cursor)
+	{
+		case '[':
+			state->cursor++;
+			cbor_parse_container(state, 0x80, ']');
+			return;
+		case '{':
+			state->cursor++;
+			cbor_parse_container(state, 0xa0, '}');
+			return;
+		case '"':
+			state->cursor++;
+			cbor_parse_text_string(state);
+			return;
+		case '+':
+		case '-':
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+			cbor_parse_number(state);
+			return;
+		case 'h':
+			if (state->cursor[1] == '\'')
+			{
+				state->cursor += 2;
+				cbor_parse_byte_string(state);
+				return;
+			}
+			break;
+	}
+
+	if (cbor_parse_keyword(state, "false", 5))
+		cbor_parse_append_byte(state->out, 0xf4);
+	else if (cbor_parse_keyword(state, "true", 4))
+		cbor_parse_append_byte(state->out, 0xf5);
+	else if (cbor_parse_keyword(state, "null", 4))
+		cbor_parse_append_byte(state->out, 0xf6);
+	else if (cbor_parse_keyword(state, "undefined", 9))
+		cbor_parse_append_byte(state->out, 0xf7);
+	else if (cbor_parse_keyword(state, "NaN", 3))
+		appendBinaryStringInfo(state->out, "\xf9\x7e\x00", 3);
+	else if (cbor_parse_keyword(state, "Infinity", 8))
+		appendBinaryStringInfo(state->out, "\xf9\x7c\x00", 3);
+	else if (cbor_parse_keyword(state, "simple", 6))
+	{
+		uint64		value;
+
+		cbor_parse_expect(state, '(');
+		cbor_parse_skip_space(state);
+		if (*state->cursor == '+')
+			state->cursor++;
+		value = cbor_parse_uint(state);
+		if (value > 0xFF)
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("bad cbor representation"),
+					 errdetail("simple value " UINT64_FORMAT " is out of range", value)));
+		cbor_parse_append_byte(state->out, 0xf8);
+		cbor_parse_append_byte(state->out, (uint8) value);
+		cbor_parse_expect(state, ')');
+	}
+	else
+		cbor_parse_error(state);
+}
+
+/*
+ * Parse the diagnostic notation in str and append its binary encoding to
+ * out.
+ */
+void
+cbor_parse(const char *str, StringInfo out)
+{
+	CborParseState state;
+
+	state.cursor = str;
+	state.out = out;
+
+	cbor_parse_value(&state);
+
+	cbor_parse_skip_space(&state);
+	if (*state.cursor != '\0')
+		cbor_parse_error(&state);
+}
@@ -0,0 +1,88 @@
+#include "cbor.h"
+
+#include "funcapi.h"
+#include "utils/builtins.h"
+
+bool		cbor_track_stats = false;
+CborStats	cbor_counters;
+
+#define CBOR_STATS_COLS 6
+
+/*
+ * Return one row per kind of work with its calls, bytes and time in
+ * milliseconds.  The decoder also reports the items it decoded and the
+ * deepest nesting it has seen.  Columns which are not measured for a kind
+ * are null.
+ */
+PG_FUNCTION_INFO_V1(cbor_stats);
+Datum
+cbor_stats(PG_FUNCTION_ARGS)
+{
+	static const struct
+	{
+		const char *name;
+		CborStatsCounter *counter;
+		bool		timed;
+	}			kinds[] = {
+		{"decode", &cbor_counters.decode, true},
+		{"encode", &cbor_counters.encode, true},
+		{"output", &cbor_counters.output, true},
+		{"compare", &cbor_counters.compare, true},
+		{"detoast", &cbor_counters.detoast, false}
+	};
+	FuncCallContext *funcctx;
+	Datum		values[CBOR_STATS_COLS];
+	bool		nulls[CBOR_STATS_COLS] = {false, false, false, true, true, true};
+	int			i;
+
+	if (SRF_IS_FIRSTCALL())
+	{
+		MemoryContext oldcontext;
+		TupleDesc	tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("function returning record called in context that cannot accept type record")));
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	i = funcctx->call_cntr;
+
+	if (i >= lengthof(kinds))
+		SRF_RETURN_DONE(funcctx);
+
+	values[0] = CStringGetTextDatum(kinds[i].name);
+	values[1] = Int64GetDatum(kinds[i].counter->calls);
+	values[2] = Int64GetDatum(kinds[i].counter->bytes);
+
+	if (kinds[i].counter == &cbor_counters.decode)
+	{
+		values[3] = Int64GetDatum((int64) cbor_counters.core.items);
+		values[4] = Int32GetDatum(cbor_counters.core.max_depth);
+		nulls[3] = false;
+		nulls[4] = false;
+	}
+
+	if (kinds[i].timed)
+	{
+		values[5] = Float8GetDatum(INSTR_TIME_GET_MILLISEC(kinds[i].counter->time));
+		nulls[5] = false;
+	}
+
+	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc, values, nulls)));
+}
+
+PG_FUNCTION_INFO_V1(cbor_stats_reset);
+Datum
+cbor_stats_reset(PG_FUNCTION_ARGS)
+{
+	memset(&cbor_counters, 0, sizeof(cbor_counters));
+	PG_RETURN_VOID();
+}
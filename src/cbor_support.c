@@ -0,0 +1,275 @@
+#include "cbor.h"
+
+/*
+ * Planner support functions, which are available from PostgreSQL 12 on.
+ */
+#if PG_VERSION_NUM >= 120000
+
+#include "catalog/namespace.h"
+#include "catalog/pg_type.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "nodes/supportnodes.h"
+#include "optimizer/cost.h"
+#include "optimizer/optimizer.h"
+#include "utils/array.h"
+#include "utils/builtins.h"
+#include "utils/lsyscache.h"
+
+static Datum cbor_contains_support_helper(Node *rawreq, bool contained);
+static Oid	cbor_support_operator(Oid funcid, const char *name, Oid left, Oid right);
+static Node *cbor_simplify_path(FuncExpr *expr);
+static bool cbor_path_key_is_index(text *key);
+static bool cbor_path_const(Node *node, Datum **elems, int *nelems);
+
+
+/*
+ * Support for ->, ->>, #> and #>>.  Chains of these operators with constant
+ * keys are simplified into a single #> or #>> with a constant path, so
+ * doc -> 'a' -> 'b' matches an expression index on doc #> '{a,b}' and the
+ * statistics gathered for it.  The cost of a lookup grows with the length
+ * of the path.
+ */
+PG_FUNCTION_INFO_V1(cbor_path_support);
+Datum
+cbor_path_support(PG_FUNCTION_ARGS)
+{
+	Node	   *rawreq = (Node *) PG_GETARG_POINTER(0);
+
+	if (IsA(rawreq, SupportRequestSimplify))
+	{
+		SupportRequestSimplify *req = (SupportRequestSimplify *) rawreq;
+
+		PG_RETURN_POINTER(cbor_simplify_path(req->fcall));
+	}
+
+	if (IsA(rawreq, SupportRequestCost))
+	{
+		SupportRequestCost *req = (SupportRequestCost *) rawreq;
+		List	   *args;
+		Datum	   *elems;
+		int			nelems = 1;
+
+		if (req->node == NULL)
+			PG_RETURN_POINTER(NULL);
+
+		if (IsA(req->node, OpExpr))
+			args = ((OpExpr *) req->node)->args;
+		else if (IsA(req->node, FuncExpr))
+			args = ((FuncExpr *) req->node)->args;
+		else
+			PG_RETURN_POINTER(NULL);
+
+		if (list_length(args) == 2 && exprType(lsecond(args)) == TEXTARRAYOID &&
+			!cbor_path_const(lsecond(args), &elems, &nelems))
+			PG_RETURN_POINTER(NULL);
+
+		req->startup = 0;
+		req->per_tuple = cpu_operator_cost * Max(nelems, 1);
+		PG_RETURN_POINTER(req);
+	}
+
+	PG_RETURN_POINTER(NULL);
+}
+
+/*
+ * Support for the function forms of @> and <@, which estimates them like
+ * the operators and turns them into index conditions for the gin operator
+ * class.
+ */
+PG_FUNCTION_INFO_V1(cbor_contains_support);
+Datum
+cbor_contains_support(PG_FUNCTION_ARGS)
+{
+	return cbor_contains_support_helper((Node *) PG_GETARG_POINTER(0), false);
+}
+
+PG_FUNCTION_INFO_V1(cbor_contained_support);
+Datum
+cbor_contained_support(PG_FUNCTION_ARGS)
+{
+	return cbor_contains_support_helper((Node *) PG_GETARG_POINTER(0), true);
+}
+
+
+static Datum
+cbor_contains_support_helper(Node *rawreq, bool contained)
+{
+	if (IsA(rawreq, SupportRequestSelectivity))
+	{
+		SupportRequestSelectivity *req = (SupportRequestSelectivity *) rawreq;
+		Oid			cbortype = exprType(linitial(req->args));
+		Oid			oprid = cbor_support_operator(req->funcid, contained ? "<@" : "@>", cbortype, cbortype);
+
+		if (!OidIsValid(oprid))
+			PG_RETURN_POINTER(NULL);
+
+		if (req->is_join)
+			req->selectivity = join_selectivity(req->root, oprid, req->args, req->inputcollid, req->jointype, req->sjinfo);
+		else
+			req->selectivity = restriction_selectivity(req->root, oprid, req->args, req->inputcollid, req->varRelid);
+		PG_RETURN_POINTER(req);
+	}
+
+	if (IsA(rawreq, SupportRequestIndexCondition))
+	{
+		SupportRequestIndexCondition *req = (SupportRequestIndexCondition *) rawreq;
+		FuncExpr   *expr = (FuncExpr *) req->node;
+		Node	   *indexarg;
+		Node	   *otherarg;
+		Oid			cbortype;
+		Oid			oprid;
+
+		if (!IsA(expr, FuncExpr) || list_length(expr->args) != 2)
+			PG_RETURN_POINTER(NULL);
+
+		indexarg = list_nth(expr->args, req->indexarg);
+		otherarg = list_nth(expr->args, 1 - req->indexarg);
+		if (!is_pseudo_constant_for_index(req->root, otherarg, req->index))
+			PG_RETURN_POINTER(NULL);
+
+		/* the indexed argument has to be the left one of @> */
+		cbortype = exprType(indexarg);
+		oprid = cbor_support_operator(req->funcid, (req->indexarg == 0) == contained ? "<@" : "@>", cbortype, cbortype);
+		if (!OidIsValid(oprid) || !op_in_opfamily(oprid, req->opfamily))
+			PG_RETURN_POINTER(NULL);
+
+		req->lossy = false;
+		PG_RETURN_POINTER(list_make1(make_opclause(oprid, BOOLOID, false,
+												   (Expr *) indexarg, (Expr *) otherarg,
+												   InvalidOid, expr->inputcollid)));
+	}
+
+	PG_RETURN_POINTER(NULL);
+}
+
+/*
+ * Look up an operator of the extension, which lives in the schema of its
+ * functions.
+ */
+static Oid
+cbor_support_operator(Oid funcid, const char *name, Oid left, Oid right)
+{
+	char	   *nspname = get_namespace_name(get_func_namespace(funcid));
+
+	if (!nspname)
+		return InvalidOid;
+
+	return OpernameGetOprid(list_make2(makeString(nspname), makeString(pstrdup(name))), left, right);
+}
+
+/*
+ * Return the equivalent #> or #>> operator with a constant path, or NULL if
+ * there is none or expr is one already.  A text key becomes a path element
+ * unless it could be taken for an array index, which -> never does.
+ */
+static Node *
+cbor_simplify_path(FuncExpr *expr)
+{
+	Node	   *doc;
+	Node	   *arg;
+	Oid			cbortype;
+	Oid			pathop;
+	Oid			oprid;
+	Datum	   *elems;
+	int			nelems;
+	Datum	   *inner = NULL;
+	int			ninner = 0;
+	Datum	   *path;
+	OpExpr	   *result;
+
+	if (list_length(expr->args) != 2)
+		return NULL;
+
+	doc = linitial(expr->args);
+	arg = lsecond(expr->args);
+	cbortype = exprType(doc);
+
+	if (exprType(arg) == TEXTOID)
+	{
+		Const	   *key = (Const *) arg;
+
+		if (!IsA(key, Const) || key->constisnull || cbor_path_key_is_index(DatumGetTextPP(key->constvalue)))
+			return NULL;
+		elems = &key->constvalue;
+		nelems = 1;
+	}
+	else if (exprType(arg) != TEXTARRAYOID)
+		return NULL;
+	else if (!cbor_path_const(arg, &elems, &nelems))
+		return NULL;
+
+	pathop = cbor_support_operator(expr->funcid, "#>", cbortype, TEXTARRAYOID);
+	if (!OidIsValid(pathop))
+		return NULL;
+
+	if (IsA(doc, OpExpr) && ((OpExpr *) doc)->opno == pathop &&
+		cbor_path_const(lsecond(((OpExpr *) doc)->args), &inner, &ninner))
+		doc = linitial(((OpExpr *) doc)->args);
+	else if (exprType(arg) == TEXTARRAYOID)
+		return NULL;
+
+	path = palloc((ninner + nelems) * sizeof(Datum));
+	if (ninner)
+		memcpy(path, inner, ninner * sizeof(Datum));
+	memcpy(path + ninner, elems, nelems * sizeof(Datum));
+
+	oprid = expr->funcresulttype == TEXTOID ? cbor_support_operator(expr->funcid, "#>>", cbortype, TEXTARRAYOID) : pathop;
+	if (!OidIsValid(oprid))
+		return NULL;
+
+	result = (OpExpr *) make_opclause(oprid, expr->funcresulttype, false, (Expr *) doc,
+									  (Expr *) makeConst(TEXTARRAYOID, -1, get_typcollation(TEXTARRAYOID), -1,
+														 PointerGetDatum(construct_array(path, ninner + nelems, TEXTOID, -1, false, 'i')),
+														 false, false),
+									  expr->funccollid, expr->inputcollid);
+	result->opfuncid = get_opcode(oprid);
+	result->location = expr->location;
+
+	return (Node *) result;
+}
+
+/*
+ * Whether #> would use key as an array index, see cbor_find_path.
+ */
+static bool
+cbor_path_key_is_index(text *key)
+{
+	char	   *str = text_to_cstring(key);
+	char	   *end;
+	long		index;
+
+	errno = 0;
+	index = strtol(str, &end, 10);
+	return end != str && *end == '\0' && errno == 0 && index >= PG_INT32_MIN && index <= PG_INT32_MAX;
+}
+
+/*
+ * Deconstruct a constant path without null elements.
+ */
+static bool
+cbor_path_const(Node *node, Datum **elems, int *nelems)
+{
+	Const	   *path = (Const *) node;
+	ArrayType  *array;
+	bool	   *nulls;
+	int			i;
+
+	if (!IsA(path, Const) || path->constisnull)
+		return false;
+
+	array = DatumGetArrayTypeP(path->constvalue);
+	if (ARR_NDIM(array) > 1)
+		return false;
+
+	deconstruct_array(array, TEXTOID, -1, false, 'i', elems, &nulls, nelems);
+	for (i = 0; i < *nelems; ++i)
+	{
+		if (nulls[i])
+			return false;
+	}
+
+	return true;
+}
+
+#endif
@@ -1,6 +1,7 @@
 \set ECHO none
 BEGIN;
 \i sql/cbor.sql
+\set ON_ERROR_ROLLBACK on
 \set ECHO all
 
 --
@@ -138,5 +139,345 @@ SELECT '[]'::cbor < '{}'::cbor;
 
 SELECT cbor_hash('1'::cbor) = cbor_hash('1'::cbor);
 SELECT cbor_hash('{"a": 1, "b": [2, 3]}'::cbor) = cbor_hash('{"a": 1, "b": [2, 3]}'::cbor);
+SELECT cbor_hash('[[1], 2]'::cbor) = cbor_hash('[[1, 2]]'::cbor);
+SELECT cbor_hash('0.0'::cbor) = cbor_hash('-0.0'::cbor);
+SELECT cbor_hash_extended('{"a": [1, "x"]}'::cbor, 0) & 4294967295 = cbor_hash('{"a": [1, "x"]}'::cbor)::int8 & 4294967295;
+SELECT cbor_hash_extended('1'::cbor, 0) = cbor_hash_extended('1'::cbor, 1);
+
+--
+-- access operator tests
+--
+SELECT '{"a": 1, "b": [2, 3]}'::cbor -> 'a';
+SELECT '{"a": 1, "b": [2, 3]}'::cbor -> 'b';
+SELECT '{"a": 1, "b": [2, 3]}'::cbor -> 'c';
+SELECT '{"a": 1, "b": [2, 3]}'::cbor -> 'b' -> 1;
+SELECT '{"a": 1, "b": [2, 3]}'::cbor -> 'b' -> -2;
+SELECT '[1, "x", {"y": null}]'::cbor -> 3;
+SELECT '[1, "x", {"y": null}]'::cbor -> 2 -> 'y';
+SELECT '{1: "one", -2: "minus two"}'::cbor -> -2;
+SELECT '{"a": "text", "b": null, "c": h''0102''}'::cbor ->> 'a';
+SELECT '{"a": "text", "b": null, "c": h''0102''}'::cbor ->> 'b';
+SELECT '{"a": "text", "b": null, "c": h''0102''}'::cbor ->> 'c';
+SELECT '["a", "b"]'::cbor ->> 1;
+SELECT '["ä", "a\u0000b"]'::cbor ->> 0;
+SELECT '["ä", "a\u0000b"]'::cbor ->> 1;
+SELECT cbor_decode('\x816261ff') #>> '{0}';
+SELECT '{"a": {"b": [10, 20, {"c": true}]}}'::cbor #> '{a,b,2,c}';
+SELECT '{"a": {"b": [10, 20, {"c": true}]}}'::cbor #>> '{a,b,1}';
+SELECT '{"a": {"b": [10, 20, {"c": true}]}}'::cbor #> '{a,x}';
+SELECT '{"a": {"b": [10, 20, {"c": true}]}}'::cbor #> '{a,b,x}';
+SELECT cbor_extract_path_text('{"a": {"b": "c"}}', 'a', 'b');
+
+--
+-- sorted map tests
+--
+SELECT * FROM cbor_encode_decode_test('\xa9616808616707616606616505616404616303616202616101616100');
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1, "a": 0}'::cbor -> 'a';
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1, "a": 0}'::cbor -> 'e';
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1, "a": 0}'::cbor -> 'x';
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1, 0: 0}'::cbor -> 0;
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1}'::cbor = '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1}'::cbor;
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1}'::cbor = '{"a": 1, "b": 2, "c": 3, "d": 4, "e": 5, "f": 6, "g": 7, "h": 8}'::cbor;
+
+--
+-- containment tests
+--
+SELECT '{"a": 1, "b": [1, 2, 3]}'::cbor @> '{"b": [3, 1]}';
+SELECT '{"a": 1, "b": [1, 2, 3]}'::cbor @> '{"a": 2}';
+SELECT '{"a": 1, "b": [1, 2, 3]}'::cbor @> '{"c": 1}';
+SELECT '{"a": 1}'::cbor <@ '{"a": 1, "b": 2}';
+SELECT '{"a": 1, "b": 2}'::cbor <@ '{"a": 1}';
+SELECT '[1, [2, 3]]'::cbor @> '[[3]]';
+SELECT '[1, [2, 3]]'::cbor @> '[3]';
+SELECT '1(2)'::cbor @> '1(2)';
+SELECT '1(2)'::cbor @> '2(2)';
+SELECT '{"h": 8, "g": 7, "f": 6, "e": 5, "d": 4, "c": 3, "b": 2, "a": 1}'::cbor @> '{"c": 3, "h": 8}';
+CREATE TABLE cbor_gin_test (doc cbor);
+INSERT INTO cbor_gin_test VALUES ('{"site": "x", "n": 1}'), ('{"site": "y", "n": 2}'), ('{"site": "x", "tags": ["a", "b"]}'), ('[1, 2]');
+CREATE INDEX cbor_gin_test_idx ON cbor_gin_test USING gin (doc);
+SET enable_seqscan = off;
+SELECT doc FROM cbor_gin_test WHERE doc @> '{"site": "x"}' ORDER BY doc;
+SELECT count(*) FROM cbor_gin_test WHERE doc @> '{"tags": ["b"]}';
+SELECT count(*) FROM cbor_gin_test WHERE doc @> '{}';
+SELECT count(*) FROM cbor_gin_test WHERE doc @> '[2]';
+RESET enable_seqscan;
+
+--
+-- binary decoder tests
+--
+SELECT cbor_decode('\x9f018202039f0405ffff');
+SELECT cbor_decode('\xbf61610161629f02ffff');
+SELECT cbor_decode('\x7f626869616cff');
+SELECT cbor_decode('\xf98001');
+SELECT cbor_decode('\x1a0000');
+SELECT cbor_decode('\x9f01');
+SELECT cbor_decode('\x8201ff');
+SELECT cbor_decode('\xbf01ff');
+SELECT cbor_decode('\x7f01ff');
+SELECT cbor_decode('\x1f');
+SELECT cbor_decode('\x1c');
+
+--
+-- raw storage type tests
+--
+SELECT '{"a": [1, 2.5, "x"], "b": h''0102''}'::cbor_raw;
+SELECT cbor_raw_send('[1, 2, 3]');
+SELECT pg_column_size('[1, 2, 3]'::cbor_raw);
+SELECT '{"a": [1, 2]}'::cbor_raw -> 'a';
+SELECT '{"a": [1, 2]}'::cbor_raw = '{"a": [1, 2]}'::cbor;
+SELECT '[1, {"b": 2}]'::cbor::cbor_raw;
+CREATE TABLE cbor_raw_test (doc cbor_raw);
+INSERT INTO cbor_raw_test VALUES ('{"id": 1}'::cbor), ('{"id": 2}');
+SELECT doc ->> 'id' FROM cbor_raw_test ORDER BY 1;
+
+--
+-- compact scalar tests
+--
+SELECT pg_column_size('[1, 2, 3]'::cbor), pg_column_size('[1.5, 1.1]'::cbor), pg_column_size('[false, null, undefined]'::cbor);
+SELECT cbor_decode('\x821affffffff1b0000000100000000');
+SELECT '4294967295'::cbor < '4294967296'::cbor, '1.5'::cbor < '1.1'::cbor, cbor_hash('1.5') = cbor_hash(cbor_decode('\xfb3ff8000000000000'));
+
+--
+-- text output tests
+--
+SELECT cbor_decode('\x6a610a22625c0963080c0d'), cbor_decode('\x44deadbeef');
+
+--
+-- text parser tests
+--
+SELECT 'h''DEADbeef'''::cbor, '-0'::cbor, '+1 ( "x" )'::cbor;
+SELECT cbor_encode('"\u00e9\u20ac\ud83d\ude00"');
+SELECT '[1,]'::cbor;
+SELECT '{"a": 1'::cbor;
+SELECT '18446744073709551616'::cbor;
+
+--
+-- sort support tests
+--
+SELECT 'NaN'::cbor > '1.0'::cbor;
+SELECT 'NaN'::cbor = 'NaN'::cbor;
+SELECT '-0.0'::cbor = '0.0'::cbor;
+SELECT v FROM (VALUES ('NaN'::cbor), ('"abcd"'), ('[[1, 2]]'), ('-0.0'), ('1.5'), ('"abce"'), ('[[1], 2]'), ('4294967296'), ('false'), ('"abcde"'), ('-1'), ('7'), ('{"a": 1}'), ('h''00'''), ('-Infinity'), ('["ab"]'), ('8'), ('1(2)'), ('null'), ('["a"]')) AS t(v) ORDER BY v;
+SELECT bool_and(a <= b) FROM (SELECT v AS a, lead(v) OVER (ORDER BY v) AS b FROM (SELECT ('[' || i % 100 || ', "' || i || '"]')::cbor FROM generate_series(1, 20000) AS i) AS t(v)) AS s;
+
+--
+-- out of line storage tests
+--
+CREATE TABLE cbor_toast_test (id int, doc cbor);
+ALTER TABLE cbor_toast_test ALTER COLUMN doc SET STORAGE external;
+INSERT INTO cbor_toast_test SELECT i, ('{"id": ' || i || ', "pad": "' || repeat('x', 10000) || '", "tags": [' || i || ', 2, 3]}')::cbor FROM generate_series(3, 1, -1) AS i;
+SELECT id, doc -> 'id', doc ->> 'id', doc #> '{tags,0}', length(doc ->> 'pad') FROM cbor_toast_test ORDER BY doc;
+SELECT a.id, b.id, a.doc = b.doc, a.doc < b.doc FROM cbor_toast_test a, cbor_toast_test b WHERE a.id <= b.id ORDER BY 1, 2;
+
+--
+-- set returning function tests
+--
+SELECT cbor_array_elements('[1, "a", [2, 3], {"b": null}]');
+SELECT count(*) FROM cbor_array_elements('[]');
+SELECT * FROM cbor_each('{"a": 1, 2: [3], null: h''00''}');
+SELECT cbor_object_keys('{"i": 1, "h": 2, "g": 3, "f": 4, "e": 5, "d": 6, "c": 7, "b": 8}');
+SELECT sum((e ->> 'n')::int) FROM cbor_array_elements('[{"n": 1}, {"n": 2}, {"n": 3}]') AS e;
+SELECT cbor_array_elements('{}');
+SELECT * FROM cbor_each('[1]');
+SELECT * FROM cbor_each(cbor_decode('\xa2616101626261ff02'));
+SELECT cbor_object_keys(cbor_decode('\xa2616101626261ff02'));
+SELECT cbor_object_keys('{"a\u0000": 1}');
+
+--
+-- aggregate tests
+--
+SELECT cbor_agg(i) FROM generate_series(1, 3) AS i;
+SELECT cbor_agg(v) FROM (VALUES (true), (false), (NULL)) AS t(v);
+SELECT cbor_agg(v) FROM (VALUES (-1.5::float8), ('NaN'), (-5000000000::int8)) AS t(v);
+SELECT cbor_agg(v) FROM (VALUES (12::numeric), (-1.25)) AS t(v);
+SELECT cbor_agg(v) FROM (VALUES ('abc'::text), ('d')) AS t(v);
+SELECT cbor_agg(v) FROM (VALUES ('\x0102'::bytea)) AS t(v);
+SELECT cbor_agg(v) FROM (VALUES ('{"x": [1, 2]}'::cbor), ('[]')) AS t(v);
+SELECT cbor_agg('2020-01-01'::date);
+SELECT cbor_agg(i) FROM generate_series(1, 0) AS i;
+SELECT i % 2, cbor_agg(i ORDER BY i) FROM generate_series(1, 6) AS i GROUP BY 1 ORDER BY 1;
+SELECT cbor_map_agg('k' || i, i) FROM generate_series(1, 3) AS i;
+SELECT cbor_map_agg(k, v) -> 'k5' FROM (SELECT 'k' || i, i * i FROM generate_series(1, 10) AS i) AS t(k, v);
+SELECT cbor_map_agg(k, v) FROM (VALUES (1, 'a'), (NULL, 'b')) AS t(k, v);
+CREATE TABLE cbor_parallel_test (i int);
+ALTER TABLE cbor_parallel_test SET (parallel_workers = 4);
+INSERT INTO cbor_parallel_test SELECT generate_series(1, 10);
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 4;
+EXPLAIN (COSTS OFF) SELECT cbor_agg(i) FROM cbor_parallel_test;
+SELECT (SELECT sum(e::int8) FROM cbor_array_elements(a) AS e) AS total FROM (SELECT cbor_agg(i) FROM cbor_parallel_test) AS t(a);
+SELECT cbor_map_agg('k' || i, i * i) -> 'k5' FROM cbor_parallel_test;
+SELECT cbor_agg(i) FROM cbor_parallel_test WHERE i > 10;
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+--
+-- modification tests
+--
+SELECT cbor_set('{"a": 1, "b": [1, 2, {"c": "x"}]}', '{b,2,c}', '[true]');
+SELECT cbor_set('{"a": 1}', '{n}', '1.5'), cbor_set('{"a": 1}', '{n}', '1.5', false), cbor_set('{"a": 1}', '{n,m}', '1.5');
+SELECT cbor_set('[1, 2]', '{-1}', '0'), cbor_set('[1, 2]', '{-5}', '0'), cbor_set('[1, 2]', '{5}', '0');
+SELECT cbor_set('[1, 2]', '{x}', '0');
+SELECT '{"a": 1, "b": 2, "a": 3}'::cbor - 'a', '["a", 1, "b"]'::cbor - 'a', '[1, 2, 3]'::cbor - -1, '{1: "a", "1": "c"}'::cbor - 1;
+SELECT '1'::cbor - 'a';
+SELECT '{"a": 1, "b": [1, 2]}'::cbor #- '{b,0}', '{"a": 1, "b": [1, 2]}'::cbor #- '{a}', '{"a": 1}'::cbor #- '{z,0}';
+SELECT '[1, 2]'::cbor || '[3]', '{"a": 1, "b": 2}'::cbor || '{"b": [3], "c": 4}', '1'::cbor || '"x"';
+SELECT cbor_set(cbor_set('{"i": 1, "h": 2, "g": 3, "f": 4, "e": 5, "d": 6, "c": 7, "b": 8}', '{a}', '0'), '{e}', '50') -> 'e';
+DO $$
+DECLARE
+	doc cbor := '{}';
+BEGIN
+	FOR i IN 1..20 LOOP
+		doc := cbor_set(doc, ARRAY['k' || i], i::text::cbor);
+	END LOOP;
+	RAISE NOTICE '% %', doc -> 'k13', (SELECT count(*) FROM cbor_object_keys(doc));
+END;
+$$;
+
+--
+-- expanded value tests
+--
+SELECT d, d -> 'k3', d -> 'x' FROM (SELECT '{"k1": 1, "k2": 2, "k3": 3, "k4": 4, "k5": 5, "k6": 6, "k7": 7, "k8": 8, "k9": 9, "k10": 10}'::cbor || '{"k3": 30, "x": 1, "x": 2}') AS t(d);
+SELECT d, d -> 'k1', d -> 'a' FROM (SELECT '{"k1": 1, "k2": 2, "k3": 3, "k4": 4, "k5": 5, "k6": 6, "k7": 7, "k8": 8, "k9": 9, "k10": 10}'::cbor || '{"k10": 100, "k1": 10, "a": 0, "b": 0, "c": 0, "d": 0, "e": 0, "f": 0, "a": 1}') AS t(d);
+SELECT '{"a": 1, "b": 2, "c": 3, "d": 4, "e": 5, "f": 6, "g": 7, "a": 8}'::cbor || '{"a": 0, "z": 0}';
+SELECT d, d -> 'k11', d -> 'k3' FROM (SELECT ('{"k1": 1, "k2": 2, "k3": 3, "k4": 4, "k5": 5, "k6": 6, "k7": 7, "k8": 8, "k9": 9, "k10": 10}'::cbor || '{"k11": 11}') - 'k2') AS t(d);
+SELECT cbor_encode('{"a": 1(1.5), "b": [h''00'', "x", -1000000], "c": 0}'::cbor || '{"c": 1}'), '[1]'::cbor || '{"a": 1}', '{"a": 1}'::cbor || '2';
+DO $$
+DECLARE
+	doc cbor := '{}';
+BEGIN
+	FOR i IN 1..20 LOOP
+		doc := doc || ('{"k' || i || '": ' || i || '}')::cbor;
+	END LOOP;
+	FOR i IN 1..20 BY 2 LOOP
+		doc := doc - ('k' || i);
+	END LOOP;
+	RAISE NOTICE '% % %', doc -> 'k14', doc -> 'k13', (SELECT count(*) FROM cbor_object_keys(doc));
+END;
+$$;
+DO $$
+DECLARE
+	doc cbor := '{"a": {"b": [0, 0]}, "c": "x"}';
+	size bigint;
+BEGIN
+	FOR i IN 1..10000 LOOP
+		doc := cbor_set(doc, '{a,b,1}', ('"' || repeat('v', i % 97) || '"')::cbor);
+	END LOOP;
+	IF to_regclass('pg_backend_memory_contexts') IS NOT NULL THEN
+		EXECUTE 'SELECT sum(total_bytes) FROM pg_backend_memory_contexts WHERE name = ''expanded cbor''' INTO size;
+		IF size > 65536 THEN
+			RAISE EXCEPTION 'expanded cbor uses % bytes', size;
+		END IF;
+	END IF;
+	RAISE NOTICE '%', doc;
+END;
+$$;
+CREATE AGGREGATE cbor_set_test(text[], cbor, bool) (SFUNC = cbor_set, STYPE = cbor, INITCOND = '{"a": {"b": 0}, "c": [1, 2]}');
+CREATE AGGREGATE cbor_concat_test(cbor) (SFUNC = cbor_concat, STYPE = cbor, INITCOND = '{}');
+SELECT cbor_set_test('{a,b}', (i % 7)::text::cbor, true) FROM generate_series(1, 20000) AS i;
+SELECT cbor_concat_test(('{"k": ' || i || ', "n": [' || i || ']}')::cbor) FROM generate_series(1, 20000) AS i;
+-- a little endian map of eight pairs stored unsorted, as before maps were sorted
+CREATE CAST (bytea AS cbor) WITHOUT FUNCTION;
+CREATE TABLE cbor_unsorted_test AS SELECT '\xc40000a008000000080000601000000018000060200000002800006030000000380000604000000048000060500000005800006060000000680000607000000078000060800000000500000068000000010000000000000005000000670000000200000000000000050000006600000003000000000000000500000065000000040000000000000005000000640000000500000000000000050000006300000006000000000000000500000062000000070000000000000005000000610000000800000000000000'::bytea::cbor AS doc;
+DROP CAST (bytea AS cbor);
+SELECT doc, pg_column_size(doc) FROM cbor_unsorted_test;
+SELECT cbor_delete(doc, 'z'), cbor_delete(doc, 'z') -> 'c' FROM cbor_unsorted_test;
+SELECT pg_column_size(cbor_delete(doc, 'z')), pg_column_size(doc #- '{z}'), pg_column_size(cbor_set(doc, '{z}', '0', false)) FROM cbor_unsorted_test;
+
+--
+-- jsonb conversion tests
+--
+SELECT '{"a": 1, 2: "b", null: [h''fb'']}'::cbor::jsonb;
+SELECT '[1.5, -5, 18446744073709551615, true, null, undefined, "x", NaN]'::cbor::jsonb;
+SELECT '{"ä": "ö"}'::cbor::jsonb;
+SELECT '{"a": "a\u0000b"}'::cbor::jsonb;
+SELECT '{"a\u0000b": 1}'::cbor::jsonb;
+SELECT cbor_decode('\xa16261ff01')::jsonb;
+SELECT '1(1500000000)'::cbor::jsonb, 'h''fbff'''::cbor::jsonb, '22(h''fbff'')'::cbor::jsonb;
+SET cbor.jsonb_bytes = hex;
+SELECT 'h''fbff'''::cbor::jsonb;
+SET cbor.jsonb_tags = object;
+SELECT '[1(2)]'::cbor::jsonb;
+SET cbor.jsonb_tags = error;
+SELECT '1(2)'::cbor::jsonb;
+RESET cbor.jsonb_bytes;
+RESET cbor.jsonb_tags;
+SELECT '{"b": [1, 2.5, "x"], "a": {"c": null}, "d": true}'::jsonb::cbor;
+SELECT '123456789012345678901234'::jsonb::cbor, '-18446744073709551616'::jsonb::cbor, '"s"'::jsonb::cbor;
+SELECT '[1.0, -2.00, 1e2, 9223372036854775808, -9223372036854775809]'::jsonb::cbor;
+SELECT '{"i": 1, "h": 2, "g": 3, "f": 4, "e": 5, "d": 6, "c": 7, "b": 8}'::jsonb::cbor -> 'e';
+
+--
+-- typed extraction tests
+--
+SELECT ('{"reading": 21.5}'::cbor -> 'reading')::float8, '-7'::cbor::float8, '3'::cbor::float8 * 2;
+SELECT '9223372036854775807'::cbor::int8, '-9223372036854775808'::cbor::int8, '2.5'::cbor::int8, 'null'::cbor::int8 IS NULL;
+SELECT '9223372036854775808'::cbor::int8;
+SELECT '"1"'::cbor::int8;
+SELECT 'h''00ff10'''::cbor::bytea, cbor_to_bytea('h''''');
+SELECT '"ab"'::cbor::bytea;
+SET TimeZone = 'UTC';
+SET DateStyle = 'ISO';
+SELECT '0("2013-03-21T20:04:00Z")'::cbor::timestamptz, '1(1363896240)'::cbor::timestamptz, '1(1363896240.5)'::cbor::timestamptz;
+SELECT '1("x")'::cbor::timestamptz;
+SELECT '1363896240'::cbor::timestamptz;
+RESET TimeZone;
+RESET DateStyle;
+SELECT sum(cbor_to_float8(value)) FROM cbor_array_elements('[1, 2.5, null, -4]');
+
+--
+-- planner support tests
+--
+CREATE TABLE cbor_path_test (doc cbor);
+INSERT INTO cbor_path_test SELECT ('{"id": ' || i || ', "tags": [' || i % 3 || ']}')::cbor FROM generate_series(1, 20) i;
+CREATE INDEX cbor_path_test_idx ON cbor_path_test ((doc #> '{id}'));
+CREATE INDEX cbor_path_test_gin_idx ON cbor_path_test USING gin (doc);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT doc FROM cbor_path_test WHERE doc -> 'id' = '7';
+EXPLAIN (COSTS OFF) SELECT count(*) FROM cbor_path_test WHERE cbor_contains(doc, '{"tags": [1]}');
+EXPLAIN (COSTS OFF) SELECT count(*) FROM cbor_path_test WHERE cbor_contained('{"tags": [2]}', doc);
+SELECT doc FROM cbor_path_test WHERE doc -> 'id' = '7';
+SELECT count(*) FROM cbor_path_test WHERE cbor_contains(doc, '{"tags": [1]}');
+SELECT count(*) FROM cbor_path_test WHERE cbor_contained('{"tags": [2]}', doc);
+RESET enable_seqscan;
+SELECT doc -> 'a' -> 'b', doc ->> 'a', doc -> '0', doc #> '{a}' ->> 'b' FROM (VALUES ('{"a": {"b": 1}, "0": 2}'::cbor), ('[{"b": 3}, 4]')) t(doc);
+EXPLAIN (VERBOSE, COSTS OFF) SELECT doc -> 'a' -> 'b', doc -> 0 FROM cbor_path_test;
+
+--
+-- statistics tests
+--
+SELECT cbor_stats_reset();
+SET cbor.track_stats = on;
+SELECT cbor_decode('\xa26161016162820203'), cbor_encode('[1, 2]');
+SELECT '{"a": 1}'::cbor < '{"a": 2}'::cbor AS lt;
+SELECT operation, calls, bytes, items, max_depth, total_time >= 0 AS timed FROM cbor_stats() WHERE operation IN ('decode', 'encode', 'output');
+SELECT operation, calls, total_time >= 0 AS timed FROM cbor_stats() WHERE operation IN ('compare', 'detoast');
+RESET cbor.track_stats;
+SELECT cbor_decode('\x01');
+SELECT calls FROM cbor_stats() WHERE operation = 'decode';
+SELECT cbor_stats_reset();
+SELECT sum(calls) AS calls FROM cbor_stats();
+
+--
+-- canonical encoding tests
+--
+SELECT cbor_encode_canonical('{"b": 1, "a": 2, 10: 3, "aa": 4, -1: 5}'), cbor_encode('{"b": 1, "a": 2, 10: 3, "aa": 4, -1: 5}');
+SELECT cbor_encode_canonical('[{"y": 1, "x": {"d": 1, "c": 2}}, 1({"b": 0, "a": 0})]');
+SELECT cbor_encode_canonical('{"i": 0, "h": 1, "g": 2, "f": 3, "e": 4, "d": 5, "c": 6, "b": 7, "a": 8}');
+SELECT cbor_encode_canonical(cbor_decode('\xbf6162820102616100ff'));
+SELECT cbor_encode_canonical('{"b": 1, "a": 2}') = cbor_encode_canonical('{"a": 2, "b": 1}') AS same, '{"b": 1, "a": 2}'::cbor = '{"a": 2, "b": 1}'::cbor AS equal;
+SELECT cbor_canonicalize('{"b": 1, "a": 2}'), cbor_canonicalize('{"b": 1, "a": 2}') = cbor_canonicalize('{"a": 2, "b": 1}') AS equal, cbor_canonicalize('[1, {"y": {"d": 0, "c": 0}, "x": 1}]');
+
+--
+-- sequence tests
+--
+SELECT cbor_decode_sequence('\x0102820304a1616101f6');
+SELECT count(*) FROM cbor_decode_sequence('\x');
+SELECT cbor_decode_sequence('\x0182');
+SELECT cbor_decode_sequence_lo(lo_from_bytea(0, '\xc1fb3ff8000000000000bf6161a1616200ff9f01820203ff'));
 
 ROLLBACK;